@@ -12,11 +12,25 @@
 
 #include <esp_log.h>
 #include <esp_http_client.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <atomic>
 #include <cmath>
 #include <cstring>
+#include <dirent.h>
 #include <string>
+#include <sys/stat.h>
 
+#include "bundle/page_bundle.h"
+#include "cache/page_cache.h"
+#include "compress/page_pack.h"
+#include "find/text_find.h"
+#include "history/url_history.h"
 #include "html2text/html2text.h"
+#include "layout/text_layout.h"
+#include "search/text_index.h"
+#include "spsc/spsc_ring.h"
+#include "util/ascii.h"
 
 constexpr auto *TAG = "TactileWeb";
 
@@ -35,23 +49,228 @@ static int getToolbarHeight(UiScale uiScale) {
 // Global state variables
 static lv_obj_t *toolbar = nullptr;
 static lv_obj_t *url_input = nullptr;
-static lv_obj_t *text_area = nullptr;
+static lv_obj_t *text_label = nullptr;
 static lv_obj_t *text_container = nullptr;
+static lv_obj_t *text_spacer = nullptr;
 static lv_obj_t *wifi_button = nullptr;
 static lv_obj_t *wifi_card = nullptr;
 static lv_obj_t *loading_label = nullptr;
 static lv_obj_t *retry_button = nullptr;
 static lv_obj_t *status_label = nullptr;
+static lv_obj_t *menu_list = nullptr;
+static lv_obj_t *page_mode_item = nullptr;
+static lv_obj_t *pager_bar = nullptr;
+static lv_obj_t *pager_label = nullptr;
+static lv_obj_t *prev_page_button = nullptr;
+static lv_obj_t *next_page_button = nullptr;
+static lv_obj_t *find_bar = nullptr;
+static lv_obj_t *find_input = nullptr;
+static lv_obj_t *find_count_label = nullptr;
+static lv_obj_t *popup_list = nullptr;
+static lv_obj_t *search_input = nullptr;
+static lv_obj_t *bookmark_item = nullptr;
+static lv_obj_t *suggest_list = nullptr;
 
 static AppHandle app_handle = nullptr;
 static char last_url[256] = {0};
 static char initial_url[256] = "http://example.com";
 static bool is_loading = false;
 
+// The label shows page text straight from our buffer (LVGL only keeps the
+// pointer), so the 8KB text is never copied into LVGL's heap. page_text
+// owns the current page; messages live in message_text or are literals.
+static char* page_text = nullptr;
+static char message_text[512];
+
+// The converter task wraps page text with text_layout_wrap() and the view
+// works from its line index. The label only holds a window of lines around
+// the viewport, cut off by a NUL written over the start of the next line
+// (saved in cut_char) and moved down to the window's first line, while a
+// spacer gives the container the height of the whole text. LVGL so never
+// lays out more than the window, and its lines match ours.
+static uint32_t* line_starts = nullptr;     // see text_layout_wrap()
+static size_t line_count = 0;
+static int32_t line_height = 1;
+static size_t window_first = 0;
+static size_t window_last = 0;
+static size_t reading_line = 0;             // first line on screen
+static int32_t line_shift = 0;              // y of line 0, see finishReflow()
+static size_t cut_offset = 0;               // offset of the NUL, 0 if none
+static char cut_char = '\0';
+
+// A text size change rewraps page_text on a reflow task. While it reads the
+// text the view leaves it untouched: no cut, no soft breaks, and a text
+// that gets replaced is handed to the task to free.
+struct ReflowJob {
+    char* text;
+    size_t len;
+    TextMetrics metrics;
+    int32_t width;
+    uint32_t generation;
+    uint32_t* lines;
+    size_t line_count;
+};
+
+static ReflowJob* reflow_job = nullptr;
+static bool reflow_orphaned = false;        // the task frees reflow_job->text
+static bool reflow_pending = false;         // the size changed again meanwhile
+static size_t reading_offset = 0;           // kept across the reflow
+
+// Paginated mode shows one screen of lines at a time. Flipping replaces the
+// label text once instead of scrolling, which redraws far less on slow SPI
+// panels.
+constexpr lv_coord_t kPagerHeight = 36;
+
+static bool paged_mode = false;
+static size_t current_page = 0;
+
+// Text sizes the menu steps through, as far as the firmware has them built
+// in. text_size indexes kTextFonts, -1 keeps the theme font.
+static const lv_font_t* const kTextFonts[] = {
+#if CONFIG_LV_FONT_MONTSERRAT_12
+    &lv_font_montserrat_12,
+#endif
+#if CONFIG_LV_FONT_MONTSERRAT_14
+    &lv_font_montserrat_14,
+#endif
+#if CONFIG_LV_FONT_MONTSERRAT_16
+    &lv_font_montserrat_16,
+#endif
+#if CONFIG_LV_FONT_MONTSERRAT_18
+    &lv_font_montserrat_18,
+#endif
+#if CONFIG_LV_FONT_MONTSERRAT_20
+    &lv_font_montserrat_20,
+#endif
+    nullptr
+};
+constexpr int32_t kTextFontCount = (int32_t)(sizeof(kTextFonts) / sizeof(kTextFonts[0])) - 1;
+
+static int32_t text_size = -1;
+
+// Find in page: offsets of the find bar's matches in page_text, in order.
+// The bar takes the pager's place at the bottom while it is open.
+constexpr size_t kMaxMatches = 256;
+
+static bool find_open = false;
+static uint32_t* find_matches = nullptr;
+static size_t find_count = 0;
+static size_t find_current = 0;
+
+// Outline of the page: where its headings start, recorded by the converter
+constexpr size_t kMaxHeadings = 64;
+
+static Html2TextHeading* outline = nullptr;
+static size_t outline_count = 0;
+
+// Tabs. The active tab's page lives in page_text and the view. Background
+// tabs keep their page packed (see page_pack()) while they fit in
+// kTabBudget; past that the least recently used drop to just their URL and
+// reading position, and come back from the page cache or the network.
+constexpr size_t kMaxTabs = 6;
+constexpr size_t kTabBudget = 24 * 1024;   // bytes held by background tabs
+
+struct Tab {
+    char url[256];
+    char title[96];
+    uint8_t* packed;            // nullptr for the active tab, or when discarded
+    size_t packed_len;
+    size_t reading_offset;
+    uint32_t last_used;
+};
+
+static Tab tabs[kMaxTabs];
+static size_t tab_count = 0;
+static size_t active_tab = 0;
+static uint32_t tab_clock = 0;
+static size_t restore_offset = 0;           // for the page a tab is loading again
+
+// Converted pages on flash, by URL, packed like background tabs. Stays open
+// while the app is loaded, as fetch tasks can outlive the view.
+constexpr size_t kCacheSegmentSize = 32 * 1024;
+constexpr size_t kCacheSegments = 4;
+
+static PageCache* page_cache = nullptr;
+
+// Words of the pages loaded, for searching them by content. Opened with the
+// cache; indexes up to kIndexTerms distinct words per page.
+constexpr size_t kIndexTerms = 1024;
+constexpr size_t kMaxSearchResults = 16;
+
+static TextIndex* text_index = nullptr;
+
+// Searches run on a task of their own, since the index stays locked while
+// the converter merges a page into it and rewrites the whole index file.
+// The list shown keeps its job for the buttons to open.
+struct SearchJob {
+    const char* query;      // stored after the job
+    uint32_t generation;
+    size_t count;
+    char urls[kMaxSearchResults][256];
+    char titles[kMaxSearchResults][96];
+};
+
+static SearchJob* search_results = nullptr;
+static uint32_t search_generation = 0;      // a new search or popup drops older ones
+
+// Visited URLs and bookmarks. A few of those starting with what's typed are
+// offered under url_input, on buttons built once and relabelled.
+constexpr size_t kMaxSuggestions = 4;
+constexpr size_t kMaxBookmarks = 32;
+
+static UrlHistory* url_history = nullptr;
+static lv_obj_t* suggest_labels[kMaxSuggestions] = {};
+
+// One offline bundle open at a time, from a *.twb file in kBundleDir on the
+// SD card or the app's "bundles" directory, or with
+// TACTILEWEB_BUNDLE_PARTITION from the kBundlePartition data partition.
+// Its pages open in tabs as "bundle:<path>", resolved in whichever bundle
+// is open, and come straight from it instead of the cache or network.
+constexpr const char* kBundleScheme = "bundle:";
+constexpr const char* kBundleDir = "/sdcard/tactileweb";
+constexpr const char* kBundlePartition = "webbundle";
+constexpr size_t kMaxBundles = 8;
+constexpr size_t kMaxBundlePages = 64;      // listed; the rest by following links
+constexpr size_t kMaxBundleLinks = 64;
+
+static PageBundle* page_bundle = nullptr;
+static char bundle_sources[kMaxBundles][128];   // file paths, or a partition label
+
 // Forward declarations
 static void fetchAndDisplay(const char* url);
 static void showWifiPrompt();
 static void updateStatusLabel(const char* text, lv_palette_t color = LV_PALETTE_NONE);
+static void showMessage(const char* text);
+static void showPage(size_t index);
+static void updateWindow(bool force);
+static void showPageText();
+static void setVisible(lv_obj_t* obj, bool visible);
+static void savePagedMode();
+static void changeTextSize(int32_t step);
+static void openFind();
+static void closeFind();
+static void runFind();
+static void showMatch(size_t index);
+static void showLine(size_t line);
+static void openOutline();
+static void openTabs();
+static void openSearch();
+static void runSearch();
+static void openSavedPage(const char* url, const char* title);
+static void updateSuggestions();
+static void openBookmarks();
+static bool isBundleUrl(const char* url);
+static void openBundles();
+static void openBundlePages();
+static void openBundleLinks();
+
+static uint32_t nowMicros() {
+    return (uint32_t)tt_kernel_get_micros();
+}
+
+// Conversion runs in slices of a few milliseconds with a yield in between,
+// so a large page can't starve the idle task and trip the task watchdog
+static const Html2TextBudget convert_budget = {0, 4000, nowMicros};
 
 static bool is_wifi_connected() {
     WifiRadioState state = tt_wifi_get_radio_state();
@@ -62,12 +281,33 @@ static bool is_wifi_connected() {
 static void url_input_cb(lv_event_t* e) {
     const char* url = lv_textarea_get_text(static_cast<const lv_obj_t*>(lv_event_get_target(e)));
     
-    if (url && strlen(url) > 0) {
+    setVisible(suggest_list, false);
+    if (url && isBundleUrl(url)) {
+        // A copy, as showing the tab sets the field's text
+        std::string page = url;
+        openSavedPage(page.c_str(), "");
+        tt_lvgl_software_keyboard_hide();
+    } else if (url && strlen(url) > 0) {
         fetchAndDisplay(url);
         tt_lvgl_software_keyboard_hide();
     }
 }
 
+static void url_changed_cb(lv_event_t* e) {
+    updateSuggestions();
+}
+
+static void suggestion_cb(lv_event_t* e) {
+    // A copy, as setting the field's text relabels the suggestions
+    size_t index = (size_t)(uintptr_t)lv_event_get_user_data(e);
+    char url[256];
+    snprintf(url, sizeof(url), "%s", lv_label_get_text(suggest_labels[index]));
+    lv_textarea_set_text(url_input, url);
+    setVisible(suggest_list, false);
+    tt_lvgl_software_keyboard_hide();
+    fetchAndDisplay(url);
+}
+
 static void wifi_connect_cb(lv_event_t* e) {
     tt_app_start("WifiManage");
 }
@@ -87,11 +327,183 @@ static void focus_url_cb(lv_event_t* e) {
 }
 
 static void clear_cb(lv_event_t* e) {
-    if (text_area) {
-        lv_textarea_set_text(text_area, "");
+    if (text_label) {
+        showMessage("");
+    }
+}
+
+static void menu_cb(lv_event_t* e) {
+    bool show = lv_obj_has_flag(menu_list, LV_OBJ_FLAG_HIDDEN);
+    if (show) {
+        const char* url = tabs[active_tab].url;
+        if (url_history && url_history_is_bookmarked(url_history, url)) {
+            lv_obj_add_state(bookmark_item, LV_STATE_CHECKED);
+        } else {
+            lv_obj_remove_state(bookmark_item, LV_STATE_CHECKED);
+        }
+    }
+    setVisible(menu_list, show);
+}
+
+static void page_mode_cb(lv_event_t* e) {
+    setVisible(menu_list, false);
+    paged_mode = !paged_mode;
+    if (paged_mode) {
+        lv_obj_add_state(page_mode_item, LV_STATE_CHECKED);
+    } else {
+        lv_obj_remove_state(page_mode_item, LV_STATE_CHECKED);
+    }
+    savePagedMode();
+    if (page_text) {
+        showPageText();
+    }
+}
+
+static void prev_page_cb(lv_event_t* e) {
+    if (current_page > 0) {
+        showPage(current_page - 1);
+    }
+}
+
+static void next_page_cb(lv_event_t* e) {
+    showPage(current_page + 1);
+}
+
+static void smaller_text_cb(lv_event_t* e) {
+    setVisible(menu_list, false);
+    changeTextSize(-1);
+}
+
+static void larger_text_cb(lv_event_t* e) {
+    setVisible(menu_list, false);
+    changeTextSize(1);
+}
+
+static void find_menu_cb(lv_event_t* e) {
+    setVisible(menu_list, false);
+    openFind();
+}
+
+static void find_input_cb(lv_event_t* e) {
+    runFind();
+}
+
+static void find_next_cb(lv_event_t* e) {
+    if (find_count > 0) {
+        showMatch(find_current + 1 < find_count ? find_current + 1 : 0);
     }
 }
 
+static void find_ready_cb(lv_event_t* e) {
+    tt_lvgl_software_keyboard_hide();
+    find_next_cb(e);
+}
+
+static void find_prev_cb(lv_event_t* e) {
+    if (find_count > 0) {
+        showMatch(find_current > 0 ? find_current - 1 : find_count - 1);
+    }
+}
+
+static void find_close_cb(lv_event_t* e) {
+    closeFind();
+}
+
+static void outline_menu_cb(lv_event_t* e) {
+    setVisible(menu_list, false);
+    openOutline();
+}
+
+static void popup_close_cb(lv_event_t* e) {
+    setVisible(popup_list, false);
+}
+
+static void tabs_menu_cb(lv_event_t* e) {
+    setVisible(menu_list, false);
+    openTabs();
+}
+
+static void search_menu_cb(lv_event_t* e) {
+    setVisible(menu_list, false);
+    openSearch();
+}
+
+static void search_ready_cb(lv_event_t* e) {
+    tt_lvgl_software_keyboard_hide();
+    runSearch();
+}
+
+static void search_item_cb(lv_event_t* e) {
+    setVisible(popup_list, false);
+    auto i = (size_t)(uintptr_t)lv_event_get_user_data(e);
+    if (search_results && i < search_results->count) {
+        openSavedPage(search_results->urls[i], search_results->titles[i]);
+    }
+}
+
+static void bookmark_cb(lv_event_t* e) {
+    setVisible(menu_list, false);
+    const Tab* tab = &tabs[active_tab];
+    if (!url_history || tab->url[0] == '\0') return;
+    bool bookmarked = !url_history_is_bookmarked(url_history, tab->url);
+    if (url_history_set_bookmark(url_history, tab->url, tab->title, bookmarked)) {
+        url_history_save(url_history);
+        updateStatusLabel(bookmarked ? "Bookmarked" : "Bookmark removed");
+    }
+}
+
+static void bookmarks_menu_cb(lv_event_t* e) {
+    setVisible(menu_list, false);
+    openBookmarks();
+}
+
+static void bookmark_entry_cb(lv_event_t* e) {
+    setVisible(popup_list, false);
+    // Listed afresh, as a visit since the popup opened may have moved the
+    // strings
+    UrlHistoryItem items[kMaxBookmarks];
+    size_t index = (size_t)(uintptr_t)lv_event_get_user_data(e);
+    if (url_history && index < url_history_bookmarks(url_history, items, kMaxBookmarks)) {
+        char url[256];
+        char title[96];
+        snprintf(url, sizeof(url), "%s", items[index].url);
+        snprintf(title, sizeof(title), "%s", items[index].title);
+        openSavedPage(url, title);
+    }
+}
+
+static void bundles_menu_cb(lv_event_t* e) {
+    setVisible(menu_list, false);
+    openBundles();
+}
+
+static void links_menu_cb(lv_event_t* e) {
+    setVisible(menu_list, false);
+    openBundleLinks();
+}
+
+static void outline_item_cb(lv_event_t* e) {
+    setVisible(popup_list, false);
+    size_t index = (size_t)(uintptr_t)lv_event_get_user_data(e);
+    // Mid-reflow there is no line index to jump by
+    if (index < outline_count && line_count > 0) {
+        showLine(text_layout_find_line(line_starts, line_count, outline[index].offset));
+    }
+}
+
+static void text_scroll_cb(lv_event_t* e) {
+    if (!page_text || line_count == 0 || paged_mode) return;
+
+    // Back at the top after a reflow moved the text to keep the reading
+    // position: lay it out from the top again
+    if (line_shift != 0 && lv_obj_get_scroll_y(text_container) <= 0) {
+        line_shift = 0;
+        showPageText();
+        return;
+    }
+    updateWindow(false);
+}
+
 // URL and content management
 static void loadLastUrl() {
     PreferencesHandle prefs = tt_preferences_alloc("tactileweb");
@@ -116,6 +528,35 @@ static void saveLastUrl(const char* url) {
     }
 }
 
+static void loadPagedMode() {
+    PreferencesHandle prefs = tt_preferences_alloc("tactileweb");
+    if (!tt_preferences_opt_bool(prefs, "paged_mode", &paged_mode)) {
+        paged_mode = false;
+    }
+    tt_preferences_free(prefs);
+}
+
+static void savePagedMode() {
+    PreferencesHandle prefs = tt_preferences_alloc("tactileweb");
+    tt_preferences_put_bool(prefs, "paged_mode", paged_mode);
+    tt_preferences_free(prefs);
+}
+
+static void loadTextSize() {
+    PreferencesHandle prefs = tt_preferences_alloc("tactileweb");
+    if (!tt_preferences_opt_int32(prefs, "text_size", &text_size) ||
+        text_size < -1 || text_size >= kTextFontCount) {
+        text_size = -1;
+    }
+    tt_preferences_free(prefs);
+}
+
+static void saveTextSize() {
+    PreferencesHandle prefs = tt_preferences_alloc("tactileweb");
+    tt_preferences_put_int32(prefs, "text_size", text_size);
+    tt_preferences_free(prefs);
+}
+
 static bool isValidUrl(const char* url) {
     if (!url || strlen(url) < 7) return false;
     // TODO: Add strncmp to tt_init, and use that
@@ -128,9 +569,281 @@ static bool isValidUrl(const char* url) {
 }
 
 // UI State Management
+static void setVisible(lv_obj_t* obj, bool visible) {
+    if (!obj) return;
+    if (visible) {
+        lv_obj_remove_flag(obj, LV_OBJ_FLAG_HIDDEN);
+    } else {
+        lv_obj_add_flag(obj, LV_OBJ_FLAG_HIDDEN);
+    }
+}
+
+static void restoreCut() {
+    if (cut_offset != 0) {
+        page_text[cut_offset] = cut_char;
+        cut_offset = 0;
+    }
+}
+
+static bool reflowing() {
+    return reflow_job && reflow_job->text == page_text;
+}
+
+static void freePageText() {
+    restoreCut();
+    if (page_text && reflowing()) {
+        reflow_orphaned = true;
+    } else {
+        free(page_text);
+    }
+    page_text = nullptr;
+    free(line_starts);
+    line_starts = nullptr;
+    line_count = 0;
+    window_first = 0;
+    window_last = 0;
+    reading_line = 0;
+    line_shift = 0;
+    current_page = 0;
+    reflow_pending = false;
+    find_count = 0;
+    find_current = 0;
+    free(outline);
+    outline = nullptr;
+    outline_count = 0;
+}
+
+// Shows lines [first, last) with the first one at y
+static void showLines(size_t first, size_t last, lv_coord_t y) {
+    restoreCut();
+    if (last < line_count) {
+        cut_offset = text_layout_offset(line_starts[last]);
+        cut_char = page_text[cut_offset];
+        page_text[cut_offset] = '\0';
+    }
+    window_first = first;
+    window_last = last;
+    lv_obj_set_y(text_label, y);
+    lv_label_set_text_static(text_label, page_text + text_layout_offset(line_starts[first]));
+}
+
+static size_t linesPerPage() {
+    int32_t height = lv_obj_get_content_height(text_container) - kPagerHeight;
+    return height > line_height ? (size_t)(height / line_height) : 1;
+}
+
+static void showPage(size_t index) {
+    size_t per_page = linesPerPage();
+    size_t pages = (line_count + per_page - 1) / per_page;
+    if (index >= pages) return;
+
+    current_page = index;
+    size_t first = index * per_page;
+    reading_line = first;
+    showLines(first, first + per_page < line_count ? first + per_page : line_count, 0);
+
+    lv_label_set_text_fmt(pager_label, "%u / %u", (unsigned)(index + 1), (unsigned)pages);
+    if (index > 0) {
+        lv_obj_remove_state(prev_page_button, LV_STATE_DISABLED);
+    } else {
+        lv_obj_add_state(prev_page_button, LV_STATE_DISABLED);
+    }
+    if (index + 1 < pages) {
+        lv_obj_remove_state(next_page_button, LV_STATE_DISABLED);
+    } else {
+        lv_obj_add_state(next_page_button, LV_STATE_DISABLED);
+    }
+}
+
+// Keeps a window of three screens around the scroll position, moving it
+// only once the viewport gets near its edge
+static void updateWindow(bool force) {
+    size_t visible = (size_t)(lv_obj_get_content_height(text_container) / line_height) + 1;
+    int32_t scroll_y = lv_obj_get_scroll_y(text_container) - line_shift;
+    size_t top = scroll_y > 0 ? (size_t)(scroll_y / line_height) : 0;
+    if (top >= line_count) top = line_count - 1;
+    reading_line = top;
+    if (!force && top >= window_first && top + visible <= window_last) return;
+
+    size_t first = top > visible ? top - visible : 0;
+    size_t last = top + 2 * visible < line_count ? top + 2 * visible : line_count;
+    showLines(first, last, (lv_coord_t)((int32_t)first * line_height + line_shift));
+}
+
+// Shows page_text in the current mode. Without a line index (out of memory)
+// the label gets the whole text and wraps it itself.
+static void showPageText() {
+    bool paged = paged_mode && line_count > 0;
+    setVisible(pager_bar, paged && !find_open);
+    if (paged) {
+        lv_obj_remove_flag(text_container, LV_OBJ_FLAG_SCROLLABLE);
+        lv_obj_set_height(text_spacer, 0);
+        // Open the page holding the top line of the scrolled view
+        showPage(reading_line / linesPerPage());
+    } else if (line_count > 0) {
+        lv_obj_add_flag(text_container, LV_OBJ_FLAG_SCROLLABLE);
+        int32_t height = (int32_t)line_count * line_height + line_shift;
+        lv_obj_set_height(text_spacer, (lv_coord_t)(height > 0 ? height : 0));
+        updateWindow(true);
+    } else {
+        lv_obj_add_flag(text_container, LV_OBJ_FLAG_SCROLLABLE);
+        lv_obj_set_height(text_spacer, 0);
+        lv_obj_set_y(text_label, 0);
+        lv_label_set_text_static(text_label, page_text);
+    }
+}
+
+// Brings a line to the top of the view: in paginated mode by opening its
+// page, otherwise by moving the text so the line sits at the current scroll
+// position, as scrolling is out of reach (see focus_url_cb). text_scroll_cb
+// undoes the shift once the user is back at the top.
+static void showLine(size_t line) {
+    reading_line = line;
+    line_shift = paged_mode ? 0 : lv_obj_get_scroll_y(text_container) - (int32_t)line * line_height;
+    showPageText();
+}
+
+// Shows a malloc'd page text and takes ownership of it and of its line
+// index (which may be nullptr)
+static void setPageText(char* text, uint32_t* lines, size_t count, int32_t height) {
+    freePageText();
+    page_text = text;
+    line_starts = lines;
+    line_count = count;
+    line_height = height > 0 ? height : 1;
+    showPageText();
+    if (find_open) {
+        runFind();
+    }
+}
+
+// Shows text that outlives the label: a literal or message_text
+static void showMessage(const char* text) {
+    lv_obj_set_y(text_label, 0);
+    lv_label_set_text_static(text_label, text);
+    freePageText();
+    setVisible(pager_bar, false);
+    lv_obj_set_height(text_spacer, 0);
+    lv_obj_add_flag(text_container, LV_OBJ_FLAG_SCROLLABLE);
+}
+
+// Takes ownership of the page's headings, from html2text_stream_take_headings()
+static void setOutline(Html2TextHeading* headings, size_t count) {
+    free(outline);
+    outline = headings;
+    outline_count = count;
+}
+
+// The outline, tab, search and bookmark lists share one popup, filled afresh each
+// time it opens; its first entry closes it
+static void openPopup(const char* title) {
+    search_generation++;
+    free(search_results);
+    search_results = nullptr;
+    lv_obj_clean(popup_list);
+    lv_obj_t* close = lv_list_add_button(popup_list, LV_SYMBOL_CLOSE, title);
+    lv_obj_add_event_cb(close, popup_close_cb, LV_EVENT_CLICKED, nullptr);
+}
+
+static void openOutline() {
+    openPopup("Outline");
+
+    if (outline_count == 0) {
+        lv_list_add_text(popup_list, "No headings on this page");
+    }
+    for (size_t i = 0; i < outline_count; i++) {
+        // The heading's first line, indented by level; the window cut can end it early
+        char entry[64];
+        size_t indent = (size_t)(outline[i].level - 1) * 2;
+        memset(entry, ' ', indent);
+        size_t len = indent;
+        const char* heading = page_text + outline[i].offset;
+        while (len < sizeof(entry) - 1 && *heading != '\0' && *heading != '\n') {
+            entry[len++] = *heading++;
+        }
+        // Don't leave half a UTF-8 character at the end
+        if (len == sizeof(entry) - 1) {
+            while (len > indent && ((uint8_t)entry[len - 1] & 0xC0) == 0x80) len--;
+            if (len > indent && (uint8_t)entry[len - 1] >= 0xC0) len--;
+        }
+        entry[len] = '\0';
+
+        lv_obj_t* item = lv_list_add_button(popup_list, nullptr, entry);
+        lv_obj_add_event_cb(item, outline_item_cb, LV_EVENT_CLICKED, (void*)(uintptr_t)i);
+    }
+    setVisible(popup_list, true);
+}
+
+static void showMatch(size_t index) {
+    find_current = index;
+    lv_label_set_text_fmt(find_count_label, "%u/%u", (unsigned)(index + 1), (unsigned)find_count);
+    // Without a line index (out of memory, or mid-reflow) there's nothing to jump by
+    if (line_count > 0) {
+        showLine(text_layout_find_line(line_starts, line_count, find_matches[index]));
+    }
+}
+
+// Searches the whole page on every keystroke and jumps to the first match
+// from the reading position on
+static void runFind() {
+    find_count = 0;
+    TextFind find;
+    const char* pattern = lv_textarea_get_text(find_input);
+    size_t pattern_len = strlen(pattern);
+    if (pattern_len > kTextFindMaxLen) {
+        lv_label_set_text_static(find_count_label, "Too long");
+        return;
+    }
+    if (page_text && find_matches && text_find_compile(&find, pattern, pattern_len)) {
+        // The window cut would hide matches behind it
+        bool cut = cut_offset != 0;
+        restoreCut();
+        find_count = text_find_all(&find, page_text, strlen(page_text), find_matches, kMaxMatches);
+        if (cut && find_count == 0) {
+            showPageText();
+        }
+    }
+
+    if (find_count == 0) {
+        lv_label_set_text_static(find_count_label, pattern[0] != '\0' ? "0/0" : "");
+        return;
+    }
+    size_t from = line_count > 0 ? text_layout_offset(line_starts[reading_line]) : 0;
+    size_t index = 0;
+    while (index < find_count && find_matches[index] < from) index++;
+    showMatch(index < find_count ? index : 0);
+}
+
+static void openFind() {
+    if (!find_matches) {
+        find_matches = (uint32_t*)malloc(kMaxMatches * sizeof(uint32_t));
+        if (!find_matches) return;
+    }
+    find_open = true;
+    setVisible(pager_bar, false);
+    setVisible(find_bar, true);
+    lv_obj_add_state(find_input, LV_STATE_FOCUSED);
+    runFind();
+}
+
+static void closeFind() {
+    find_open = false;
+    find_count = 0;
+    free(find_matches);
+    find_matches = nullptr;
+    setVisible(find_bar, false);
+    tt_lvgl_software_keyboard_hide();
+    if (page_text && line_count > 0) {
+        showPageText();
+    }
+}
+
 static void updateStatusLabel(const char* text, lv_palette_t color) {
     if (!status_label && toolbar) {
         status_label = lv_label_create(toolbar);
+        // Page titles can be long, keep them clear of the toolbar buttons
+        lv_label_set_long_mode(status_label, LV_LABEL_LONG_DOT);
+        lv_obj_set_width(status_label, LV_PCT(30));
         lv_obj_align(status_label, LV_ALIGN_LEFT_MID, 10, 0);
     }
     
@@ -143,37 +856,25 @@ static void updateStatusLabel(const char* text, lv_palette_t color) {
 }
 
 static void clearContent() {
-    if (retry_button) {
-        lv_obj_delete(retry_button);
-        retry_button = nullptr;
-    }
-    if (wifi_card) {
-        lv_obj_delete(wifi_card);
-        wifi_card = nullptr;
-        wifi_button = nullptr; // wifi_button is a child of wifi_card, so it's deleted too
-    }
+    setVisible(retry_button, false);
+    setVisible(wifi_card, false);
 }
 
 static void clearLoading() {
     is_loading = false;
-    if (loading_label) {
-        lv_obj_delete(loading_label);
-        loading_label = nullptr;
-    }
+    setVisible(loading_label, false);
 }
 
-static void showWifiPrompt() {
-    clearContent();
-    clearLoading();
-
-    lv_textarea_set_text(text_area, "");
-
+// The Wi-Fi prompt, loading label and retry button are built once, hidden,
+// and only toggled afterwards, so switching states doesn't churn the LVGL
+// heap or re-layout the screen.
+static void createOverlays() {
     // Get display metrics for responsive sizing
     lv_coord_t width = lv_obj_get_width(text_container);
     bool is_small = (width < 240);
 
     // Create a card-style container for the WiFi prompt
-    wifi_card = lv_obj_create(text_area);
+    wifi_card = lv_obj_create(text_container);
     lv_obj_set_size(wifi_card, LV_PCT(90), LV_SIZE_CONTENT);
     lv_obj_center(wifi_card);
     lv_obj_set_style_radius(wifi_card, is_small ? 8 : 16, 0);
@@ -221,6 +922,165 @@ static void showWifiPrompt() {
 
     lv_obj_add_event_cb(wifi_button, wifi_connect_cb, LV_EVENT_CLICKED, nullptr);
 
+    // Loading label
+    loading_label = lv_label_create(text_container);
+    lv_obj_set_width(loading_label, LV_PCT(90));
+    lv_label_set_long_mode(loading_label, LV_LABEL_LONG_WRAP);
+    lv_obj_center(loading_label);
+    lv_obj_set_style_text_align(loading_label, LV_TEXT_ALIGN_CENTER, 0);
+
+    // Retry button
+    retry_button = lv_btn_create(text_container);
+    lv_obj_set_size(retry_button, 100, 35);
+    lv_obj_t* retry_label = lv_label_create(retry_button);
+    lv_label_set_text(retry_label, "Retry");
+    lv_obj_center(retry_label);
+    lv_obj_align(retry_button, LV_ALIGN_BOTTOM_MID, 0, -20);
+    lv_obj_add_event_cb(retry_button, retry_cb, LV_EVENT_CLICKED, nullptr);
+
+    // Page navigation for paginated mode, floating over the bottom of the
+    // container; pages leave kPagerHeight free for it
+    pager_bar = lv_obj_create(text_container);
+    lv_obj_add_flag(pager_bar, LV_OBJ_FLAG_FLOATING);
+    lv_obj_set_size(pager_bar, LV_PCT(100), kPagerHeight);
+    lv_obj_align(pager_bar, LV_ALIGN_BOTTOM_MID, 0, 0);
+    lv_obj_set_style_pad_all(pager_bar, 2, 0);
+    lv_obj_set_style_border_width(pager_bar, 0, 0);
+    lv_obj_set_scroll_dir(pager_bar, LV_DIR_NONE);
+
+    prev_page_button = lv_btn_create(pager_bar);
+    lv_obj_set_size(prev_page_button, 50, LV_PCT(100));
+    lv_obj_align(prev_page_button, LV_ALIGN_LEFT_MID, 0, 0);
+    lv_obj_t* prev_label = lv_label_create(prev_page_button);
+    lv_label_set_text(prev_label, LV_SYMBOL_LEFT);
+    lv_obj_center(prev_label);
+    lv_obj_add_event_cb(prev_page_button, prev_page_cb, LV_EVENT_CLICKED, nullptr);
+
+    next_page_button = lv_btn_create(pager_bar);
+    lv_obj_set_size(next_page_button, 50, LV_PCT(100));
+    lv_obj_align(next_page_button, LV_ALIGN_RIGHT_MID, 0, 0);
+    lv_obj_t* next_label = lv_label_create(next_page_button);
+    lv_label_set_text(next_label, LV_SYMBOL_RIGHT);
+    lv_obj_center(next_label);
+    lv_obj_add_event_cb(next_page_button, next_page_cb, LV_EVENT_CLICKED, nullptr);
+
+    pager_label = lv_label_create(pager_bar);
+    lv_obj_center(pager_label);
+
+    // Find bar, in the pager's place
+    find_bar = lv_obj_create(text_container);
+    lv_obj_add_flag(find_bar, LV_OBJ_FLAG_FLOATING);
+    lv_obj_set_size(find_bar, LV_PCT(100), kPagerHeight);
+    lv_obj_align(find_bar, LV_ALIGN_BOTTOM_MID, 0, 0);
+    lv_obj_set_style_pad_all(find_bar, 2, 0);
+    lv_obj_set_style_pad_column(find_bar, 4, 0);
+    lv_obj_set_style_border_width(find_bar, 0, 0);
+    lv_obj_set_scroll_dir(find_bar, LV_DIR_NONE);
+    lv_obj_set_flex_flow(find_bar, LV_FLEX_FLOW_ROW);
+    lv_obj_set_flex_align(find_bar, LV_FLEX_ALIGN_START, LV_FLEX_ALIGN_CENTER, LV_FLEX_ALIGN_CENTER);
+
+    find_input = lv_textarea_create(find_bar);
+    lv_obj_set_height(find_input, LV_PCT(100));
+    lv_obj_set_flex_grow(find_input, 1);
+    lv_obj_set_style_pad_ver(find_input, 2, 0);
+    lv_textarea_set_one_line(find_input, true);
+    // In characters, so runFind() still checks the byte length
+    lv_textarea_set_max_length(find_input, kTextFindMaxLen);
+    lv_textarea_set_placeholder_text(find_input, "Find");
+    lv_obj_add_event_cb(find_input, find_input_cb, LV_EVENT_VALUE_CHANGED, nullptr);
+    lv_obj_add_event_cb(find_input, find_ready_cb, LV_EVENT_READY, nullptr);
+
+    find_count_label = lv_label_create(find_bar);
+    lv_label_set_text_static(find_count_label, "");
+
+    const char* find_symbols[] = {LV_SYMBOL_UP, LV_SYMBOL_DOWN, LV_SYMBOL_CLOSE};
+    lv_event_cb_t find_callbacks[] = {find_prev_cb, find_next_cb, find_close_cb};
+    for (size_t i = 0; i < 3; i++) {
+        lv_obj_t* button = lv_btn_create(find_bar);
+        lv_obj_set_size(button, 30, LV_PCT(100));
+        lv_obj_t* label = lv_label_create(button);
+        lv_label_set_text(label, find_symbols[i]);
+        lv_obj_center(label);
+        lv_obj_add_event_cb(button, find_callbacks[i], LV_EVENT_CLICKED, nullptr);
+    }
+
+    setVisible(wifi_card, false);
+    setVisible(loading_label, false);
+    setVisible(retry_button, false);
+    setVisible(pager_bar, false);
+    setVisible(find_bar, false);
+}
+
+// The toolbar has no room for more buttons, so reader features live in a
+// drop-down list under the menu button
+static void createMenu(lv_obj_t* parent, lv_obj_t* anchor) {
+    menu_list = lv_list_create(parent);
+    lv_obj_set_size(menu_list, 160, LV_SIZE_CONTENT);
+    lv_obj_align_to(menu_list, anchor, LV_ALIGN_OUT_BOTTOM_RIGHT, 0, 4);
+
+    page_mode_item = lv_list_add_button(menu_list, LV_SYMBOL_FILE, "Page view");
+    if (paged_mode) {
+        lv_obj_add_state(page_mode_item, LV_STATE_CHECKED);
+    }
+    lv_obj_add_event_cb(page_mode_item, page_mode_cb, LV_EVENT_CLICKED, nullptr);
+
+    lv_obj_t* smaller_item = lv_list_add_button(menu_list, LV_SYMBOL_MINUS, "Smaller text");
+    lv_obj_add_event_cb(smaller_item, smaller_text_cb, LV_EVENT_CLICKED, nullptr);
+    lv_obj_t* larger_item = lv_list_add_button(menu_list, LV_SYMBOL_PLUS, "Larger text");
+    lv_obj_add_event_cb(larger_item, larger_text_cb, LV_EVENT_CLICKED, nullptr);
+
+    lv_obj_t* find_item = lv_list_add_button(menu_list, LV_SYMBOL_EYE_OPEN, "Find in page");
+    lv_obj_add_event_cb(find_item, find_menu_cb, LV_EVENT_CLICKED, nullptr);
+
+    lv_obj_t* outline_item = lv_list_add_button(menu_list, LV_SYMBOL_LIST, "Outline");
+    lv_obj_add_event_cb(outline_item, outline_menu_cb, LV_EVENT_CLICKED, nullptr);
+
+    lv_obj_t* tabs_item = lv_list_add_button(menu_list, LV_SYMBOL_DIRECTORY, "Tabs");
+    lv_obj_add_event_cb(tabs_item, tabs_menu_cb, LV_EVENT_CLICKED, nullptr);
+
+    lv_obj_t* search_item = lv_list_add_button(menu_list, LV_SYMBOL_DRIVE, "Search pages");
+    lv_obj_add_event_cb(search_item, search_menu_cb, LV_EVENT_CLICKED, nullptr);
+
+    // Checked while the page is bookmarked, see menu_cb
+    bookmark_item = lv_list_add_button(menu_list, LV_SYMBOL_SAVE, "Bookmark page");
+    lv_obj_add_event_cb(bookmark_item, bookmark_cb, LV_EVENT_CLICKED, nullptr);
+    lv_obj_t* bookmarks_item = lv_list_add_button(menu_list, LV_SYMBOL_BARS, "Bookmarks");
+    lv_obj_add_event_cb(bookmarks_item, bookmarks_menu_cb, LV_EVENT_CLICKED, nullptr);
+
+    lv_obj_t* bundles_item = lv_list_add_button(menu_list, LV_SYMBOL_SD_CARD, "Offline pages");
+    lv_obj_add_event_cb(bundles_item, bundles_menu_cb, LV_EVENT_CLICKED, nullptr);
+    lv_obj_t* links_item = lv_list_add_button(menu_list, LV_SYMBOL_RIGHT, "Links");
+    lv_obj_add_event_cb(links_item, links_menu_cb, LV_EVENT_CLICKED, nullptr);
+
+    setVisible(menu_list, false);
+
+    popup_list = lv_list_create(parent);
+    lv_obj_set_size(popup_list, LV_PCT(80), LV_PCT(70));
+    lv_obj_center(popup_list);
+    setVisible(popup_list, false);
+}
+
+// URL suggestions, over the top of the page under url_input
+static void createSuggestions(lv_obj_t* parent) {
+    suggest_list = lv_list_create(parent);
+    lv_obj_set_size(suggest_list, lv_obj_get_width(url_input), LV_SIZE_CONTENT);
+    lv_obj_align_to(suggest_list, url_input, LV_ALIGN_OUT_BOTTOM_LEFT, 0, 2);
+    for (size_t i = 0; i < kMaxSuggestions; i++) {
+        lv_obj_t* button = lv_list_add_button(suggest_list, nullptr, "");
+        suggest_labels[i] = lv_obj_get_child(button, 0);
+        lv_label_set_long_mode(suggest_labels[i], LV_LABEL_LONG_DOT);
+        lv_obj_add_event_cb(button, suggestion_cb, LV_EVENT_CLICKED, (void*)(uintptr_t)i);
+    }
+    setVisible(suggest_list, false);
+}
+
+static void showWifiPrompt() {
+    clearContent();
+    clearLoading();
+
+    showMessage("");
+    setVisible(wifi_card, true);
+
     updateStatusLabel("No WiFi Connection", LV_PALETTE_RED);
 }
 
@@ -230,7 +1090,6 @@ static void showLoading(const char* url = nullptr) {
     is_loading = true;
     clearContent();
     
-    loading_label = lv_label_create(text_area);
     if (url) {
         char loading_text[300];
         snprintf(loading_text, sizeof(loading_text), "Loading: %s", url);
@@ -238,32 +1097,21 @@ static void showLoading(const char* url = nullptr) {
     } else {
         lv_label_set_text(loading_label, "Loading...");
     }
-    lv_obj_center(loading_label);
-    lv_obj_set_style_text_align(loading_label, LV_TEXT_ALIGN_CENTER, 0);
+    setVisible(loading_label, true);
     
     updateStatusLabel("Loading...", LV_PALETTE_YELLOW);
 }
 
 static void showRetryButton() {
-    if (!retry_button && text_area) {
-        retry_button = lv_btn_create(text_area);
-        lv_obj_set_size(retry_button, 100, 35);
-        lv_obj_t* btn_label = lv_label_create(retry_button);
-        lv_label_set_text(btn_label, "Retry");
-        lv_obj_center(btn_label);
-        lv_obj_align(retry_button, LV_ALIGN_BOTTOM_MID, 0, -20);
-        lv_obj_add_event_cb(retry_button, retry_cb, LV_EVENT_CLICKED, nullptr);
-    }
+    setVisible(retry_button, true);
 }
 
 static void showError(const char* error_msg, const char* url = nullptr) {
     clearLoading();
     clearContent();
     
-    char full_error[512];
-    snprintf(full_error, sizeof(full_error), "Error: %s", error_msg);
-    
-    lv_textarea_set_text(text_area, full_error);
+    snprintf(message_text, sizeof(message_text), "Error: %s", error_msg);
+    showMessage(message_text);
     
     if (url && strlen(url) > 0) {
         showRetryButton();
@@ -272,154 +1120,1095 @@ static void showError(const char* error_msg, const char* url = nullptr) {
     updateStatusLabel("Error", LV_PALETTE_RED);
 }
 
-static void fetchAndDisplay(const char* url) {
-    if (!url || strlen(url) == 0) {
-        showError("Invalid URL provided");
-        return;
-    }
+// Fetch pipeline: a reader task on the Wi-Fi core downloads straight into a
+// ring buffer while a converter task on the other core turns it into text in
+// place, so conversion overlaps network I/O. The converter takes the LVGL
+// lock for its UI updates.
+#if CONFIG_FREERTOS_UNICORE
+constexpr BaseType_t kReaderCore = 0;
+constexpr BaseType_t kConverterCore = 0;
+#elif CONFIG_ESP_WIFI_TASK_PINNED_TO_CORE_1
+constexpr BaseType_t kReaderCore = 1;
+constexpr BaseType_t kConverterCore = 0;
+#else
+constexpr BaseType_t kReaderCore = 0;
+constexpr BaseType_t kConverterCore = 1;
+#endif
 
-    if (!is_wifi_connected()) {
-        showWifiPrompt();
-        return;
-    }
+constexpr size_t kRingSize = 8192;
+constexpr size_t kMaxReadSize = 2048;
+constexpr size_t kMaxTextSize = 8192;
 
-    if (!isValidUrl(url)) {
-        showError("Invalid URL format. Please use http:// or https://");
-        return;
-    }
+struct FetchPipeline {
+    char url[256];
+    uint32_t generation;            // view_generation when the fetch started
+    TaskHandle_t reader;            // nullptr if it failed to start
+    SpscRing* ring;
+    char error[64];                 // set by the reader before it closes the ring
+};
 
-    showLoading(url);
-    lv_textarea_set_text(text_area, "");
+// Bumped by onHide, so fetches still in flight stop touching the old widgets
+static std::atomic<uint32_t> view_generation{0};
 
-    // Configure HTTP client
-    esp_http_client_config_t config = {};
-    config.url = url;
+static bool fetchCancelled(const FetchPipeline* fetch) {
+    return fetch->generation != view_generation.load();
+}
+
+static void fetchReaderTask(void* arg) {
+    auto* fetch = static_cast<FetchPipeline*>(arg);
+
+    esp_http_client_config_t config = {};
+    config.url = fetch->url;
     config.method = HTTP_METHOD_GET;
     config.timeout_ms = 10000;
     config.skip_cert_common_name_check = true;
     config.buffer_size = 4096;
     config.buffer_size_tx = 1024;
-    
+
     esp_http_client_handle_t client = esp_http_client_init(&config);
     if (!client) {
-        showError("Failed to initialize HTTP client", url);
+        strcpy(fetch->error, "Failed to initialize HTTP client");
+    } else {
+        esp_err_t err = esp_http_client_open(client, 0);
+        if (err != ESP_OK) {
+            strcpy(fetch->error, "Failed to connect to server");
+            ESP_LOGE(TAG, "HTTP open failed: error code %d", err);
+        } else {
+            int content_length = esp_http_client_fetch_headers(client);
+            int status_code = esp_http_client_get_status_code(client);
+            ESP_LOGI(TAG, "Content length: %d, Status: %d", content_length, status_code);
+            if (status_code < 200 || status_code >= 300) {
+                snprintf(fetch->error, sizeof(fetch->error), "HTTP Error: %d", status_code);
+            }
+        }
+
+        while (fetch->error[0] == '\0' && !fetchCancelled(fetch)) {
+            char* span;
+            size_t space = spsc_ring_wait_write(fetch->ring, &span, portMAX_DELAY);
+            if (space == 0) break;  // the converter has all it wants
+
+            int len = esp_http_client_read(client, span, (int)(space < kMaxReadSize ? space : kMaxReadSize));
+            if (len <= 0) break;
+            spsc_ring_commit(fetch->ring, (size_t)len);
+        }
+
+        esp_http_client_cleanup(client);
+    }
+
+    // The converter deletes this task once the ring is drained, so suspend
+    // rather than exit: it may still wake us until then
+    spsc_ring_close(fetch->ring);
+    vTaskSuspend(nullptr);
+}
+
+// What the converter hands to the UI; the text and page table are malloc'd
+struct FetchResult {
+    char title[96];
+    char* text;             // nullptr when out of memory
+    uint32_t* lines;        // see text_layout_wrap()
+    size_t line_count;
+    int32_t line_height;
+    Html2TextHeading* headings;
+    size_t heading_count;
+};
+
+// Completes the conversion, destroying the stream
+static void finishFetchResult(Html2TextStream* stream, FetchResult* result) {
+    const char* title = html2text_stream_title(stream);
+    if (title) {
+        strncpy(result->title, title, sizeof(result->title) - 1);
+    }
+
+    result->headings = html2text_stream_take_headings(stream, &result->heading_count);
+
+    bool truncated = false;
+    char* plain_text = html2text_stream_finish(stream, &truncated);
+    if (plain_text && plain_text[0] != '\0' && truncated) {
+        const char* notice = "\n\n[Content truncated...]";
+        size_t text_len = strlen(plain_text);
+        char* grown = (char*)realloc(plain_text, text_len + strlen(notice) + 1);
+        if (grown) {
+            plain_text = grown;
+            strcpy(plain_text + text_len, notice);
+        }
+    }
+    result->text = plain_text;
+}
+
+// Glyph advances of the label font, rebuilt only when the font changes
+static TextMetrics text_metrics;
+static const lv_font_t* text_metrics_font = nullptr;
+static int32_t text_metrics_letter_space = 0;
+
+// Snapshots the label font and width. Runs with the LVGL lock held.
+static void captureTextMetrics(TextMetrics* metrics, int32_t* width) {
+    const lv_font_t* font = lv_obj_get_style_text_font(text_label, LV_PART_MAIN);
+    int32_t letter_space = lv_obj_get_style_text_letter_space(text_label, LV_PART_MAIN);
+    if (font != text_metrics_font || letter_space != text_metrics_letter_space) {
+        int32_t widest = 0;
+        for (uint32_t c = 0; c < 128; c++) {
+            int32_t advance = 0;
+            if (c >= 0x20 && c < 0x7F) {
+                advance = lv_font_get_glyph_width(font, c, 0) + letter_space;
+                advance = advance < 0 ? 0 : (advance > 255 ? 255 : advance);
+            }
+            text_metrics.advance[c] = (uint8_t)advance;
+            widest = advance > widest ? advance : widest;
+        }
+        text_metrics.other = (uint8_t)widest;
+        text_metrics_font = font;
+        text_metrics_letter_space = letter_space;
+    }
+    text_metrics.line_height = lv_font_get_line_height(font) +
+                               lv_obj_get_style_text_line_space(text_label, LV_PART_MAIN);
+
+    *metrics = text_metrics;
+    *width = lv_obj_get_content_width(text_container);
+}
+
+// Wraps the text here rather than on the UI thread. Without a line index
+// the label falls back to wrapping the whole text itself.
+static void layoutFetchResult(const FetchPipeline* fetch, FetchResult* result) {
+    TextMetrics metrics;
+    int32_t width = 0;
+    if (!tt_lvgl_lock(portMAX_DELAY)) return;
+    bool cancelled = fetchCancelled(fetch);
+    if (!cancelled) {
+        captureTextMetrics(&metrics, &width);
+    }
+    tt_lvgl_unlock();
+    if (cancelled) return;
+
+    // Count first, so the index is allocated at its final size
+    size_t len = strlen(result->text);
+    size_t count = text_layout_wrap(result->text, len, &metrics, width, nullptr, SIZE_MAX);
+    result->lines = (uint32_t*)malloc(count * sizeof(uint32_t));
+    if (!result->lines) return;
+    result->line_count = text_layout_wrap(result->text, len, &metrics, width, result->lines, count);
+    result->line_height = metrics.line_height;
+    text_layout_bake(result->text, result->lines, result->line_count);
+}
+
+// Text size changes. The lines on screen are wrapped right away on the UI
+// thread, starting from the paragraph that holds the reading position, and
+// a reflow task on the converter core wraps the whole text. The reading
+// position is kept as a text offset, so it survives any change of the line
+// count.
+static void startReflow();
+
+static void finishReflow(ReflowJob* job) {
+    reflow_job = nullptr;
+    bool orphaned = reflow_orphaned;
+    reflow_orphaned = false;
+    if (orphaned) {
+        free(job->text);
+    }
+
+    bool current = !orphaned && job->text == page_text && job->generation == view_generation.load() &&
+                   !reflow_pending;
+    if (current && job->lines) {
+        line_starts = job->lines;
+        line_count = job->line_count;
+        line_height = job->metrics.line_height;
+        text_layout_bake(page_text, line_starts, line_count);
+        showLine(text_layout_find_line(line_starts, line_count, reading_offset));
+    } else {
+        free(job->lines);
+        if (current) {
+            // Out of memory, let the label wrap the whole text
+            showPageText();
+        }
+    }
+    free(job);
+
+    if (reflow_pending && page_text && text_label) {
+        reflow_pending = false;
+        startReflow();
+    }
+}
+
+static void reflowTask(void* arg) {
+    auto* job = static_cast<ReflowJob*>(arg);
+
+    size_t count = text_layout_wrap(job->text, job->len, &job->metrics, job->width, nullptr, SIZE_MAX);
+    job->lines = (uint32_t*)malloc(count * sizeof(uint32_t));
+    if (job->lines) {
+        job->line_count = text_layout_wrap(job->text, job->len, &job->metrics, job->width, job->lines, count);
+    }
+
+    if (tt_lvgl_lock(portMAX_DELAY)) {
+        finishReflow(job);
+        tt_lvgl_unlock();
+    }
+    vTaskDelete(nullptr);
+}
+
+// Runs with the LVGL lock held, on unbaked text
+static void startReflow() {
+    if (reflow_job) {
+        // The running job is discarded and a new one started when it's done
+        reflow_pending = true;
         return;
     }
 
-    esp_err_t err = esp_http_client_open(client, 0);
-    if (err != ESP_OK) {
-        showError("Failed to connect to server", url);
-        ESP_LOGE(TAG, "HTTP open failed: error code %d", err);
-        esp_http_client_cleanup(client);
+    auto* job = (ReflowJob*)calloc(1, sizeof(ReflowJob));
+    if (!job) {
+        showPageText();
         return;
     }
+    job->text = page_text;
+    job->len = strlen(page_text);
+    captureTextMetrics(&job->metrics, &job->width);
+    job->generation = view_generation.load();
+    reflow_job = job;
 
-    // Get response code
-    int status_code = esp_http_client_get_status_code(client);
-    if (status_code < 200 || status_code >= 300) {
-        char error_msg[64];
-        snprintf(error_msg, sizeof(error_msg), "HTTP Error: %d", status_code);
-        showError(error_msg, url);
-        esp_http_client_cleanup(client);
+    if (xTaskCreatePinnedToCore(reflowTask, "web_reflow", 3072, job, tskIDLE_PRIORITY + 1, nullptr,
+                                kConverterCore) != pdPASS) {
+        reflow_job = nullptr;
+        free(job);
+        showPageText();
+    }
+}
+
+// Shows the lines from the one holding reading_offset to the end of the
+// screen, wrapped here, while the reflow task does the rest
+static void showReflowPreview() {
+    TextMetrics metrics;
+    int32_t width = 0;
+    captureTextMetrics(&metrics, &width);
+    size_t len = strlen(page_text);
+
+    // Soft breaks are undone, so the paragraph start is a line start
+    size_t line = reading_offset;
+    while (line > 0 && page_text[line - 1] != '\n') line--;
+    while (true) {
+        size_t next = text_layout_next_line(page_text, len, line, &metrics, width);
+        if (next > reading_offset || next >= len) break;
+        line = next;
+    }
+
+    size_t end = line;
+    int32_t visible = lv_obj_get_content_height(text_container) / metrics.line_height + 1;
+    for (int32_t i = 0; i < visible && end < len; i++) {
+        end = text_layout_next_line(page_text, len, end, &metrics, width);
+    }
+
+    setVisible(pager_bar, false);
+    lv_obj_set_y(text_label, paged_mode ? 0 : lv_obj_get_scroll_y(text_container));
+    // A copy, as the reflow task may be reading page_text
+    lv_label_set_text_fmt(text_label, "%.*s", (int)(end - line), page_text + line);
+}
+
+static void reflowPageText() {
+    if (!reflowing()) {
+        reading_offset = line_count > 0 ? text_layout_offset(line_starts[reading_line]) : 0;
+        restoreCut();
+        text_layout_unbake(page_text, line_starts, line_count);
+        free(line_starts);
+        line_starts = nullptr;
+        line_count = 0;
+    }
+    showReflowPreview();
+    startReflow();
+}
+
+static size_t readingOffset() {
+    if (reflowing()) return reading_offset;
+    return line_count > 0 ? text_layout_offset(line_starts[reading_line]) : 0;
+}
+
+static void freeTabText(Tab* tab) {
+    free(tab->packed);
+    tab->packed = nullptr;
+    tab->packed_len = 0;
+}
+
+// Packs the shown page into its tab, with the soft breaks undone so it can
+// be wrapped afresh when it comes back. If that fails the tab keeps only
+// its URL.
+static void stashPageText(Tab* tab) {
+    tab->reading_offset = readingOffset();
+    restoreCut();
+    if (!reflowing()) {
+        text_layout_unbake(page_text, line_starts, line_count);
+    }
+    tab->packed = page_pack(page_text, outline, outline_count, &tab->packed_len);
+    freePageText();
+}
+
+// Discards the least recently used background texts until the rest fit
+static void enforceTabBudget() {
+    while (true) {
+        size_t total = 0;
+        Tab* oldest = nullptr;
+        for (size_t i = 0; i < tab_count; i++) {
+            Tab* tab = &tabs[i];
+            if (i == active_tab || !tab->packed) continue;
+            total += tab->packed_len;
+            if (!oldest || tab->last_used < oldest->last_used) oldest = tab;
+        }
+        if (total <= kTabBudget) return;
+        ESP_LOGI(TAG, "Discarding tab %s", oldest->url);
+        freeTabText(oldest);
+    }
+}
+
+// Opens a bundle by file path or partition label in place of the open one,
+// and remembers it for next time
+static bool openBundle(const char* source) {
+    PageBundle* bundle = nullptr;
+    if (source[0] == '/') {
+        bundle = page_bundle_open_file(source);
+    }
+#if TACTILEWEB_BUNDLE_PARTITION
+    else {
+        bundle = page_bundle_open_partition(source);
+    }
+#endif
+    if (!bundle) {
+        ESP_LOGW(TAG, "No page bundle in %s", source);
+        return false;
+    }
+    page_bundle_close(page_bundle);
+    page_bundle = bundle;
+
+    PreferencesHandle prefs = tt_preferences_alloc("tactileweb");
+    tt_preferences_put_string(prefs, "bundle", source);
+    tt_preferences_free(prefs);
+    return true;
+}
+
+static bool isBundleUrl(const char* url) {
+    return ascii_starts_with(url, kBundleScheme);
+}
+
+// The open bundle's page for a "bundle:" URL
+static bool findBundlePage(const char* url, size_t* index) {
+    return page_bundle && isBundleUrl(url) && page_bundle_find(page_bundle, url + strlen(kBundleScheme), index);
+}
+
+// Shows the active tab: its kept page, rewrapped from the reading position
+// on like after a text size change, else the bundled or cached copy of its
+// URL, else its URL loaded again
+static void showTab() {
+    Tab* tab = &tabs[active_tab];
+    lv_textarea_set_text(url_input, tab->url);
+    clearLoading();
+    clearContent();
+
+    bool offline = isBundleUrl(tab->url);
+    size_t bundle_page = 0;
+    if (!tab->packed && offline && findBundlePage(tab->url, &bundle_page)) {
+        tab->packed = page_bundle_read_page(page_bundle, bundle_page, &tab->packed_len);
+        if (tab->title[0] == '\0') {
+            char path[8];
+            page_bundle_page_info(page_bundle, bundle_page, path, sizeof(path), tab->title, sizeof(tab->title));
+        }
+    } else if (!tab->packed && !offline && tab->url[0] != '\0' && page_cache) {
+        // One short flash read
+        tab->packed = (uint8_t*)page_cache_get(page_cache, tab->url, &tab->packed_len);
+    }
+    Html2TextHeading* headings = nullptr;
+    size_t heading_count = 0;
+    char* text = tab->packed ? page_unpack(tab->packed, tab->packed_len, &headings, &heading_count) : nullptr;
+    freeTabText(tab);
+    if (text) {
+        page_text = text;
+        setOutline(headings, heading_count);
+        reading_offset = tab->reading_offset;
+        showReflowPreview();
+        startReflow();
+        updateStatusLabel(tab->title[0] != '\0' ? tab->title : "Content Loaded", LV_PALETTE_GREEN);
+    } else if (offline) {
+        showMessage("This page isn't in the open offline bundle. Open its bundle from Offline pages in the menu.");
+        updateStatusLabel("Offline page not available", LV_PALETTE_RED);
+    } else if (tab->url[0] != '\0') {
+        fetchAndDisplay(tab->url);
+        restore_offset = tab->reading_offset;
+    } else {
+        showMessage("Enter a URL above to browse the web.");
+        updateStatusLabel("New tab");
+    }
+}
+
+static void switchTab(size_t index) {
+    // The running fetch belongs to the active tab
+    if (is_loading || index == active_tab || index >= tab_count) return;
+    if (find_open) {
+        closeFind();
+    }
+
+    Tab* tab = &tabs[active_tab];
+    if (page_text) {
+        stashPageText(tab);
+    }
+    tab->last_used = ++tab_clock;
+    active_tab = index;
+    enforceTabBudget();
+    showTab();
+}
+
+static void newTab() {
+    if (is_loading) return;
+    if (tab_count == kMaxTabs) {
+        updateStatusLabel("Close a tab first", LV_PALETTE_RED);
         return;
     }
+    memset(&tabs[tab_count], 0, sizeof(Tab));
+    tab_count++;
+    switchTab(tab_count - 1);
+}
 
-    int content_length = esp_http_client_fetch_headers(client);
-    ESP_LOGI(TAG, "Content length: %d, Status: %d", content_length, status_code);
+static void closeTab() {
+    if (is_loading) return;
+    if (find_open) {
+        closeFind();
+    }
+    showMessage("");
 
-    // Allocate buffer for HTML content (32KB max)
-    const int max_content_size = 32768;
-    char* html_content = (char*)malloc(max_content_size + 1);
-    if (!html_content) {
-        showError("Out of memory", url);
-        esp_http_client_cleanup(client);
+    freeTabText(&tabs[active_tab]);
+    memmove(&tabs[active_tab], &tabs[active_tab + 1], (tab_count - active_tab - 1) * sizeof(Tab));
+    tab_count--;
+    if (tab_count == 0) {
+        memset(&tabs[0], 0, sizeof(Tab));
+        tab_count = 1;
+    }
+    if (active_tab == tab_count) active_tab--;
+    showTab();
+}
+
+static void tab_item_cb(lv_event_t* e) {
+    setVisible(popup_list, false);
+    switchTab((size_t)(uintptr_t)lv_event_get_user_data(e));
+}
+
+static void new_tab_cb(lv_event_t* e) {
+    setVisible(popup_list, false);
+    newTab();
+}
+
+static void close_tab_cb(lv_event_t* e) {
+    setVisible(popup_list, false);
+    closeTab();
+}
+
+static void openTabs() {
+    openPopup("Tabs");
+    for (size_t i = 0; i < tab_count; i++) {
+        const Tab* tab = &tabs[i];
+        const char* name = tab->title[0] != '\0' ? tab->title : (tab->url[0] != '\0' ? tab->url : "New tab");
+        // Discarded tabs load again when opened
+        const char* icon = i == active_tab ? LV_SYMBOL_OK : (tab->packed ? LV_SYMBOL_FILE : LV_SYMBOL_REFRESH);
+        lv_obj_t* item = lv_list_add_button(popup_list, icon, name);
+        lv_obj_add_event_cb(item, tab_item_cb, LV_EVENT_CLICKED, (void*)(uintptr_t)i);
+    }
+    lv_obj_t* add = lv_list_add_button(popup_list, LV_SYMBOL_PLUS, "New tab");
+    lv_obj_add_event_cb(add, new_tab_cb, LV_EVENT_CLICKED, nullptr);
+    lv_obj_t* close = lv_list_add_button(popup_list, LV_SYMBOL_TRASH, "Close tab");
+    lv_obj_add_event_cb(close, close_tab_cb, LV_EVENT_CLICKED, nullptr);
+    setVisible(popup_list, true);
+}
+
+// Opens a search result, bookmark or bundled page in the active tab, from
+// the bundle or page cache if it's there
+static void openSavedPage(const char* url, const char* title) {
+    if (is_loading) return;
+    if (find_open) {
+        closeFind();
+    }
+    showMessage("");
+
+    Tab* tab = &tabs[active_tab];
+    freeTabText(tab);
+    strncpy(tab->url, url, sizeof(tab->url) - 1);
+    tab->url[sizeof(tab->url) - 1] = '\0';
+    strncpy(tab->title, title, sizeof(tab->title) - 1);
+    tab->title[sizeof(tab->title) - 1] = '\0';
+    tab->reading_offset = 0;
+    showTab();
+}
+
+// Keeps the close button and the search field
+static void clearSearchResults() {
+    while (lv_obj_get_child_count(popup_list) > 2) {
+        lv_obj_delete(lv_obj_get_child(popup_list, 2));
+    }
+}
+
+// Runs with the LVGL lock held
+static void finishSearch(SearchJob* job) {
+    if (job->generation != search_generation || !popup_list) {
+        free(job);
         return;
     }
-    
-    char buffer[2048];
-    int total_read = 0;
-
-    while (total_read < max_content_size) {
-        int len = esp_http_client_read(client, buffer, sizeof(buffer) - 1);
-        if (len <= 0) break;
-        
-        // Copy to html_content buffer
-        if (total_read + len <= max_content_size) {
-            memcpy(html_content + total_read, buffer, len);
-            total_read += len;
-        } else {
-            // Would overflow, copy what fits
-            int remaining = max_content_size - total_read;
-            memcpy(html_content + total_read, buffer, remaining);
-            total_read = max_content_size;
-            break;
+    clearSearchResults();
+    free(search_results);
+    search_results = job;
+    if (job->count == 0) {
+        lv_list_add_text(popup_list, "No saved page has these words");
+    }
+    for (size_t i = 0; i < job->count; i++) {
+        const char* name = job->titles[i][0] != '\0' ? job->titles[i] : job->urls[i];
+        lv_obj_t* item = lv_list_add_button(popup_list, LV_SYMBOL_FILE, name);
+        lv_obj_add_event_cb(item, search_item_cb, LV_EVENT_CLICKED, (void*)(uintptr_t)i);
+    }
+}
+
+static void searchTask(void* arg) {
+    auto* job = static_cast<SearchJob*>(arg);
+    uint32_t ids[kMaxSearchResults];
+    size_t count = text_index_search(text_index, job->query, ids, kMaxSearchResults);
+    for (size_t i = 0; i < count; i++) {
+        if (text_index_page(text_index, ids[i], job->urls[job->count], sizeof(job->urls[0]),
+                            job->titles[job->count], sizeof(job->titles[0]))) {
+            job->count++;
+        }
+    }
+    if (tt_lvgl_lock(portMAX_DELAY)) {
+        finishSearch(job);
+        tt_lvgl_unlock();
+    } else {
+        free(job);
+    }
+    vTaskDelete(nullptr);
+}
+
+// Lists the pages holding every word of the query below the search field,
+// once a search task has found them
+static void runSearch() {
+    search_generation++;
+    clearSearchResults();
+    const char* query = lv_textarea_get_text(search_input);
+    if (query[0] == '\0') return;
+    if (!text_index) {
+        lv_list_add_text(popup_list, "No saved page has these words");
+        return;
+    }
+
+    size_t len = strlen(query);
+    auto* job = (SearchJob*)calloc(1, sizeof(SearchJob) + len + 1);
+    lv_obj_t* status = lv_list_add_text(popup_list, "Searching...");
+    if (!job) {
+        lv_label_set_text(status, "Out of memory");
+        return;
+    }
+    memcpy(job + 1, query, len + 1);
+    job->query = (const char*)(job + 1);
+    job->generation = search_generation;
+    if (xTaskCreatePinnedToCore(searchTask, "web_search", 4096, job, tskIDLE_PRIORITY + 1, nullptr,
+                                kConverterCore) != pdPASS) {
+        free(job);
+        lv_label_set_text(status, "Out of memory");
+    }
+}
+
+static void openBookmarks() {
+    openPopup("Bookmarks");
+    UrlHistoryItem items[kMaxBookmarks];
+    size_t count = url_history ? url_history_bookmarks(url_history, items, kMaxBookmarks) : 0;
+    if (count == 0) {
+        lv_list_add_text(popup_list, "No bookmarks yet");
+    }
+    for (size_t i = 0; i < count; i++) {
+        const char* name = items[i].title[0] != '\0' ? items[i].title : items[i].url;
+        lv_obj_t* item = lv_list_add_button(popup_list, LV_SYMBOL_FILE, name);
+        lv_obj_add_event_cb(item, bookmark_entry_cb, LV_EVENT_CLICKED, (void*)(uintptr_t)i);
+    }
+    setVisible(popup_list, true);
+}
+
+static void bundle_page_cb(lv_event_t* e) {
+    setVisible(popup_list, false);
+    char url[256];
+    char title[96];
+    strcpy(url, kBundleScheme);
+    size_t prefix = strlen(url);
+    if (page_bundle && page_bundle_page_info(page_bundle, (size_t)(uintptr_t)lv_event_get_user_data(e),
+                                             url + prefix, sizeof(url) - prefix, title, sizeof(title))) {
+        openSavedPage(url, title);
+    }
+}
+
+static void bundle_entry_cb(lv_event_t* e) {
+    size_t index = (size_t)(uintptr_t)lv_event_get_user_data(e);
+    if (!openBundle(bundle_sources[index])) {
+        setVisible(popup_list, false);
+        updateStatusLabel("Not a page bundle", LV_PALETTE_RED);
+        return;
+    }
+    openBundlePages();
+}
+
+static void bundle_pages_cb(lv_event_t* e) {
+    openBundlePages();
+}
+
+// Adds the *.twb files in dir to the bundle list
+static void listBundleFiles(const char* dir, size_t* count) {
+    DIR* listing = opendir(dir);
+    if (!listing) return;
+    struct dirent* entry;
+    while (*count < kMaxBundles && (entry = readdir(listing)) != nullptr) {
+        size_t len = strlen(entry->d_name);
+        if (len < 5 || ascii_casecmp(entry->d_name + len - 4, ".twb") != 0) continue;
+        int written = snprintf(bundle_sources[*count], sizeof(bundle_sources[0]), "%s/%s", dir, entry->d_name);
+        if (written < 0 || (size_t)written >= sizeof(bundle_sources[0])) continue;
+        lv_obj_t* item = lv_list_add_button(popup_list, LV_SYMBOL_SD_CARD, entry->d_name);
+        lv_obj_add_event_cb(item, bundle_entry_cb, LV_EVENT_CLICKED, (void*)(uintptr_t)*count);
+        (*count)++;
+    }
+    closedir(listing);
+}
+
+// Lists the bundles there are to open, after the open one's pages
+static void openBundles() {
+    openPopup("Offline pages");
+    if (page_bundle) {
+        lv_obj_t* current = lv_list_add_button(popup_list, LV_SYMBOL_DIRECTORY, page_bundle_name(page_bundle));
+        lv_obj_add_event_cb(current, bundle_pages_cb, LV_EVENT_CLICKED, nullptr);
+    }
+    size_t count = 0;
+    listBundleFiles(kBundleDir, &count);
+    char dir[128];
+    size_t size = sizeof(dir) - sizeof("/bundles");
+    tt_app_get_user_data_path(app_handle, dir, &size);
+    strcat(dir, "/bundles");
+    listBundleFiles(dir, &count);
+#if TACTILEWEB_BUNDLE_PARTITION
+    if (count < kMaxBundles) {
+        strcpy(bundle_sources[count], kBundlePartition);
+        lv_obj_t* item = lv_list_add_button(popup_list, LV_SYMBOL_DRIVE, "Built-in pages");
+        lv_obj_add_event_cb(item, bundle_entry_cb, LV_EVENT_CLICKED, (void*)(uintptr_t)count);
+        count++;
+    }
+#endif
+    if (count == 0 && !page_bundle) {
+        char hint[96];
+        snprintf(hint, sizeof(hint), "No bundles, copy *.twb files to %s", kBundleDir);
+        lv_list_add_text(popup_list, hint);
+    }
+    setVisible(popup_list, true);
+}
+
+// Lists the open bundle's pages, by path, which puts each directory's
+// pages together
+static void openBundlePages() {
+    openPopup(page_bundle_name(page_bundle));
+    size_t count = page_bundle_page_count(page_bundle);
+    for (size_t i = 0; i < count && i < kMaxBundlePages; i++) {
+        char path[128];
+        char title[96];
+        if (!page_bundle_page_info(page_bundle, i, path, sizeof(path), title, sizeof(title))) continue;
+        lv_obj_t* item = lv_list_add_button(popup_list, LV_SYMBOL_FILE, title[0] != '\0' ? title : path);
+        lv_obj_add_event_cb(item, bundle_page_cb, LV_EVENT_CLICKED, (void*)(uintptr_t)i);
+    }
+    if (count > kMaxBundlePages) {
+        lv_list_add_text(popup_list, "More pages are reachable through Links");
+    }
+    setVisible(popup_list, true);
+}
+
+static void link_entry_cb(lv_event_t* e) {
+    setVisible(popup_list, false);
+    size_t page = 0;
+    PageBundleLink link;
+    if (!findBundlePage(tabs[active_tab].url, &page) ||
+        !page_bundle_link(page_bundle, page, (size_t)(uintptr_t)lv_event_get_user_data(e), &link)) {
+        return;
+    }
+    if (link.target == kPageBundleExternal) {
+        lv_textarea_set_text(url_input, link.url);
+        fetchAndDisplay(link.url);
+        return;
+    }
+    char url[256];
+    char title[96];
+    strcpy(url, kBundleScheme);
+    size_t prefix = strlen(url);
+    if (page_bundle_page_info(page_bundle, link.target, url + prefix, sizeof(url) - prefix, title, sizeof(title))) {
+        openSavedPage(url, title);
+    }
+}
+
+// The page view has no tappable links, so a bundled page's links are
+// followed from a list, labelled like the [n] markers in its text
+static void openBundleLinks() {
+    openPopup("Links");
+    size_t page = 0;
+    size_t count = findBundlePage(tabs[active_tab].url, &page) ? page_bundle_link_count(page_bundle, page) : 0;
+    if (count == 0) {
+        lv_list_add_text(popup_list, "No links to follow on this page");
+    }
+    for (size_t i = 0; i < count && i < kMaxBundleLinks; i++) {
+        PageBundleLink link;
+        if (!page_bundle_link(page_bundle, page, i, &link)) continue;
+        char name[96];
+        snprintf(name, sizeof(name), "[%u] %s", (unsigned)(i + 1), link.label[0] != '\0' ? link.label : link.url);
+        const char* icon = link.target == kPageBundleExternal ? LV_SYMBOL_WIFI : LV_SYMBOL_FILE;
+        lv_obj_t* item = lv_list_add_button(popup_list, icon, name);
+        lv_obj_add_event_cb(item, link_entry_cb, LV_EVENT_CLICKED, (void*)(uintptr_t)i);
+    }
+    setVisible(popup_list, true);
+}
+
+// Offers the best history entries starting with the typed text. A binary
+// search and a few relabelled buttons, well within a frame.
+static void updateSuggestions() {
+    UrlHistoryItem items[kMaxSuggestions];
+    size_t count = 0;
+    // Text set by the app (tab switches, suggestions) isn't typed
+    if (url_history && lv_obj_has_state(url_input, LV_STATE_FOCUSED)) {
+        count = url_history_suggest(url_history, lv_textarea_get_text(url_input), items, kMaxSuggestions);
+    }
+    for (size_t i = 0; i < kMaxSuggestions; i++) {
+        lv_obj_t* button = lv_obj_get_parent(suggest_labels[i]);
+        setVisible(button, i < count);
+        if (i < count) {
+            lv_label_set_text(suggest_labels[i], items[i].url);
         }
-        
-        // Update loading progress
-        if (loading_label) {
-            char progress[64];
-            snprintf(progress, sizeof(progress), "Loading... (%d bytes)", total_read);
-            lv_label_set_text(loading_label, progress);
+    }
+    setVisible(suggest_list, count > 0);
+}
+
+static void openSearch() {
+    openPopup("Search pages");
+    search_input = lv_textarea_create(popup_list);
+    lv_obj_set_width(search_input, LV_PCT(100));
+    lv_textarea_set_one_line(search_input, true);
+    lv_textarea_set_placeholder_text(search_input, "Words on the page");
+    lv_obj_add_event_cb(search_input, search_ready_cb, LV_EVENT_READY, nullptr);
+    lv_obj_add_state(search_input, LV_STATE_FOCUSED);
+    if (!text_index) {
+        lv_list_add_text(popup_list, "No search index on this device");
+    }
+    setVisible(popup_list, true);
+}
+
+// Runs with the LVGL lock held
+static void changeTextSize(int32_t step) {
+    int32_t index = text_size;
+    if (index < 0) {
+        // Start from the theme font, or the listed one closest to it
+        const lv_font_t* font = lv_obj_get_style_text_font(text_label, LV_PART_MAIN);
+        int32_t height = lv_font_get_line_height(font);
+        index = 0;
+        while (index + 1 < kTextFontCount && kTextFonts[index] != font &&
+               lv_font_get_line_height(kTextFonts[index + 1]) <= height) {
+            index++;
         }
     }
-    
-    html_content[total_read] = '\0';
-    esp_http_client_cleanup(client);
+    index += step;
+    if (index < 0 || index >= kTextFontCount || index == text_size) return;
 
-    if (total_read == 0) {
-        free(html_content);
-        showError("No content received from server", url);
+    text_size = index;
+    saveTextSize();
+    lv_obj_set_style_text_font(text_label, kTextFonts[text_size], 0);
+    if (page_text) {
+        reflowPageText();
+    }
+}
+
+// Runs with the LVGL lock held, only if the fetch still owns the view. Takes
+// the text and line index out of the result when it shows them.
+static void showFetchResult(FetchPipeline* fetch, FetchResult* result, size_t total_read) {
+    if (fetch->error[0] != '\0') {
+        showError(fetch->error, fetch->url);
         return;
     }
 
-    // Convert HTML to plain text using C function
-    char* converted = html2text_c(html_content);
-    free(html_content);
-    
-    if (!converted) {
-        showError("Out of memory during conversion", url);
+    if (total_read == 0) {
+        showError("No content received from server", fetch->url);
         return;
     }
-    
-    // Allocate final display buffer (8KB max)
-    char* plain_text = (char*)malloc(8192 + 64);
-    if (!plain_text) {
-        free(converted);
-        showError("Out of memory", url);
+
+    if (!result->text) {
+        showError("Out of memory during conversion", fetch->url);
         return;
     }
-    
-    size_t converted_len = strlen(converted);
-    if (converted_len > 8192) {
-        memcpy(plain_text, converted, 8192);
-        strcpy(plain_text + 8192, "\n\n[Content truncated...]");
-    } else if (converted_len > 0) {
-        strcpy(plain_text, converted);
-    } else {
-        strcpy(plain_text, "Content received but could not be processed.");
+
+    const char* page_title = result->title;
+    char* plain_text = result->text;
+    if (plain_text[0] == '\0') {
+        clearLoading();
+        clearContent();
+        showMessage("Content received but could not be processed.");
+        saveLastUrl(fetch->url);
+        updateStatusLabel(page_title[0] != '\0' ? page_title : "Content Loaded", LV_PALETTE_GREEN);
+        return;
     }
-    
-    free(converted);
 
+    size_t text_len = strlen(plain_text);
     clearLoading();
     clearContent();
-    lv_textarea_set_text(text_area, plain_text);
-    
+    setPageText(plain_text, result->lines, result->line_count, result->line_height);
+    setOutline(result->headings, result->heading_count);
+    result->text = nullptr;
+    result->lines = nullptr;
+    result->headings = nullptr;
+
+    strncpy(tabs[active_tab].title, page_title, sizeof(tabs[active_tab].title) - 1);
+    if (restore_offset > 0 && line_count > 0) {
+        showLine(text_layout_find_line(line_starts, line_count, restore_offset));
+    }
+    restore_offset = 0;
+
     // TODO: Not in tt_init
     // Scroll to top
-    // lv_obj_scroll_to_y(text_area, 0, LV_ANIM_ON);
-    
-    saveLastUrl(url);
-    updateStatusLabel("Content Loaded", LV_PALETTE_GREEN);
-    
-    ESP_LOGI(TAG, "Successfully loaded content from %s (%d bytes)", url, (int)strlen(plain_text));
-    
-    free(plain_text);
+    // lv_obj_scroll_to_y(text_container, 0, LV_ANIM_ON);
+
+    saveLastUrl(fetch->url);
+    if (url_history) {
+        url_history_visit(url_history, fetch->url, page_title);
+    }
+    updateStatusLabel(page_title[0] != '\0' ? page_title : "Content Loaded", LV_PALETTE_GREEN);
+
+    ESP_LOGI(TAG, "Successfully loaded content from %s (%d bytes)", fetch->url, (int)text_len);
 }
 
+static void fetchConverterTask(void* arg) {
+    auto* fetch = static_cast<FetchPipeline*>(arg);
+
+    // Convert while downloading, so the HTML never has to be held in full
+    // and the title shows up as soon as the head has arrived
+    Html2TextStream* stream = html2text_stream_create(kMaxTextSize);
+    if (stream) {
+        // Without the table the page just has no outline
+        html2text_stream_track_headings(stream, kMaxHeadings);
+    }
+    size_t total_read = 0;
+    bool title_shown = false;
+
+    while (true) {
+        const char* span;
+        size_t len = spsc_ring_wait_read(fetch->ring, &span, portMAX_DELAY);
+        if (len == 0) break;  // closed and drained
+
+        if (stream && !spsc_ring_aborted(fetch->ring)) {
+            size_t converted = 0;
+            while (converted < len) {
+                converted += html2text_stream_feed_slice(stream, span + converted, len - converted,
+                                                         &convert_budget);
+                if (converted < len) tt_kernel_delay_ticks(1);
+            }
+        }
+        total_read += len;
+        spsc_ring_release(fetch->ring, len);
+
+        // The text budget is used up, the rest of the page would be dropped
+        if (!stream || html2text_stream_full(stream) || fetchCancelled(fetch)) {
+            spsc_ring_abort(fetch->ring);
+        }
+
+        if (tt_lvgl_lock(portMAX_DELAY)) {
+            if (!fetchCancelled(fetch)) {
+                if (!title_shown && stream) {
+                    const char* title = html2text_stream_title(stream);
+                    if (title && title[0] != '\0') {
+                        updateStatusLabel(title, LV_PALETTE_YELLOW);
+                        title_shown = true;
+                    }
+                }
+
+                // Update loading progress
+                if (is_loading) {
+                    char progress[64];
+                    snprintf(progress, sizeof(progress), "Loading... (%d bytes)", (int)total_read);
+                    lv_label_set_text(loading_label, progress);
+                }
+            }
+            tt_lvgl_unlock();
+        }
+    }
+
+    // No reader if it failed to start
+    if (fetch->reader) {
+        vTaskDelete(fetch->reader);
+    }
+
+    // Finish and wrap before taking the lock for the result. The page is
+    // packed for the cache and its words collected for the search index
+    // while it has no soft breaks yet.
+    FetchResult result = {};
+    uint8_t* packed = nullptr;
+    size_t packed_len = 0;
+    uint32_t* terms = nullptr;
+    size_t term_count = 0;
+    if (stream && fetch->error[0] == '\0' && total_read > 0) {
+        finishFetchResult(stream, &result);
+        stream = nullptr;
+        if (result.text && result.text[0] != '\0') {
+            if (page_cache) {
+                packed = page_pack(result.text, result.headings, result.heading_count, &packed_len);
+            }
+            if (text_index) {
+                terms = (uint32_t*)malloc(kIndexTerms * sizeof(uint32_t));
+                if (terms) {
+                    term_count = text_index_terms(result.text, strlen(result.text), terms, kIndexTerms);
+                }
+            }
+            layoutFetchResult(fetch, &result);
+        }
+    }
+
+    bool shown = false;
+    if (tt_lvgl_lock(portMAX_DELAY)) {
+        if (!fetchCancelled(fetch)) {
+            showFetchResult(fetch, &result, total_read);
+            shown = true;
+        }
+        tt_lvgl_unlock();
+    }
+
+    // Written once the page is up, the flash writes don't hold it back
+    if (packed && shown && !page_cache_put(page_cache, fetch->url, packed, packed_len)) {
+        ESP_LOGW(TAG, "Could not cache %s", fetch->url);
+    }
+    free(packed);
+    if (terms && shown && !text_index_add(text_index, fetch->url, result.title, terms, term_count)) {
+        ESP_LOGW(TAG, "Could not index %s", fetch->url);
+    }
+    free(terms);
+
+    free(result.text);
+    free(result.lines);
+    free(result.headings);
+    html2text_stream_free(stream);
+    spsc_ring_free(fetch->ring);
+    free(fetch);
+    vTaskDelete(nullptr);
+}
+
+static void fetchAndDisplay(const char* url) {
+    if (is_loading) return;
+    restore_offset = 0;
+
+    if (!url || strlen(url) == 0) {
+        showError("Invalid URL provided");
+        return;
+    }
+
+    if (!is_wifi_connected()) {
+        showWifiPrompt();
+        return;
+    }
+
+    if (!isValidUrl(url)) {
+        showError("Invalid URL format. Please use http:// or https://");
+        return;
+    }
+
+    auto* fetch = (FetchPipeline*)calloc(1, sizeof(FetchPipeline));
+    if (!fetch) {
+        showError("Out of memory", url);
+        return;
+    }
+    fetch->ring = spsc_ring_create(kRingSize);
+    if (!fetch->ring) {
+        free(fetch);
+        showError("Out of memory", url);
+        return;
+    }
+    strncpy(fetch->url, url, sizeof(fetch->url) - 1);
+    fetch->generation = view_generation.load();
+
+    Tab* tab = &tabs[active_tab];
+    if (tab->url != url) {
+        strncpy(tab->url, url, sizeof(tab->url) - 1);
+        tab->url[sizeof(tab->url) - 1] = '\0';
+    }
+    tab->title[0] = '\0';
+
+    showLoading(url);
+    showMessage("");
+
+    // The converter owns the pipeline and frees it once the reader is done
+    if (xTaskCreatePinnedToCore(fetchConverterTask, "web_convert", 4096, fetch, tskIDLE_PRIORITY + 2, nullptr,
+                                kConverterCore) != pdPASS) {
+        spsc_ring_free(fetch->ring);
+        free(fetch);
+        showError("Failed to start download", url);
+        return;
+    }
+    if (xTaskCreatePinnedToCore(fetchReaderTask, "web_fetch", 8192, fetch, tskIDLE_PRIORITY + 3,
+                                &fetch->reader, kReaderCore) != pdPASS) {
+        // The converter already holds its stream, so rather than deleting
+        // it, let it see an empty closed ring and clean up as usual
+        fetch->reader = nullptr;
+        strcpy(fetch->error, "Failed to start download");
+        spsc_ring_close(fetch->ring);
+    }
+}
+
+#if TACTILEWEB_BENCHMARK
+// Converts a synthetic page a few times and logs the throughput. Runs on
+// the converter core while the app is up, so it sees the same cache and
+// memory pressure as a real load.
+static void benchmarkTask(void* arg) {
+    const char* sample =
+        "<div class=\"entry\"><h2>Heading</h2><p>Some <b>bold</b> and <a href=\"/page\">linked</a> text "
+        "&amp; an entity, with   collapsed\n whitespace.</p><ul><li>One</li><li>Two</li></ul></div>\n";
+    const size_t sample_len = strlen(sample);
+    const size_t html_len = 32 * 1024;
+    const int runs = 10;
+
+    char* html = (char*)malloc(html_len + 1);
+    char* out = (char*)malloc(html_len + 1);
+    if (html && out) {
+        for (size_t i = 0; i < html_len; i += sample_len) {
+            memcpy(html + i, sample, html_len - i < sample_len ? html_len - i : sample_len);
+        }
+        html[html_len] = '\0';
+
+        unsigned long start = tt_kernel_get_micros();
+        for (int run = 0; run < runs; run++) {
+            html2text_convert_into(html, html_len, out, html_len + 1, nullptr);
+        }
+        unsigned long elapsed = tt_kernel_get_micros() - start;
+        uint64_t kb_per_s = elapsed > 0 ? (uint64_t)runs * html_len * 1000000ULL / 1024 / elapsed : 0;
+        ESP_LOGI(TAG, "html2text benchmark: %u KB/s, %lu us per %u KB", (unsigned)kb_per_s, elapsed / runs,
+                 (unsigned)(html_len / 1024));
+    }
+
+    free(html);
+    free(out);
+    vTaskDelete(nullptr);
+}
+#endif
+
 // C callback functions
+// Opens the page cache, search index and history in the app's data
+// directory, and the last opened bundle, once
+static void openStores() {
+    if (page_cache || text_index || url_history) return;
+    char path[128];
+    size_t size = sizeof(path) - sizeof("/cache");
+    tt_app_get_user_data_path(app_handle, path, &size);
+    mkdir(path, 0775);
+    size_t base = strlen(path);
+    strcat(path, "/cache");
+    page_cache = page_cache_open(path, kCacheSegmentSize, kCacheSegments);
+    if (!page_cache) {
+        ESP_LOGW(TAG, "No page cache in %s", path);
+    }
+    strcpy(path + base, "/index");
+    text_index = text_index_open(path);
+    if (!text_index) {
+        ESP_LOGW(TAG, "No search index in %s", path);
+    }
+    strcpy(path + base, "/history.bin");
+    url_history = url_history_open(path);
+
+    char bundle[sizeof(bundle_sources[0])] = "";
+    PreferencesHandle prefs = tt_preferences_alloc("tactileweb");
+    if (tt_preferences_opt_string(prefs, "bundle", bundle, sizeof(bundle)) && bundle[0] != '\0') {
+        openBundle(bundle);
+    }
+    tt_preferences_free(prefs);
+}
+
 extern "C" void onShow(void *app, void *data, lv_obj_t *parent) {
     app_handle = app;
+    openStores();
 
     // Get UI scale and calculate layout
     UiScale uiScale = tt_hal_configuration_get_ui_scale();
@@ -448,6 +2237,15 @@ extern "C" void onShow(void *app, void *data, lv_obj_t *parent) {
     lv_obj_align_to(clear_btn, focus_btn, LV_ALIGN_OUT_LEFT_MID, -5, 0);
     lv_obj_add_event_cb(clear_btn, clear_cb, LV_EVENT_CLICKED, nullptr);
 
+    // Menu button
+    lv_obj_t* menu_btn = lv_btn_create(toolbar);
+    lv_obj_set_size(menu_btn, 40, 30);
+    lv_obj_t* menu_label = lv_label_create(menu_btn);
+    lv_label_set_text(menu_label, LV_SYMBOL_LIST);
+    lv_obj_center(menu_label);
+    lv_obj_align_to(menu_btn, clear_btn, LV_ALIGN_OUT_LEFT_MID, -5, 0);
+    lv_obj_add_event_cb(menu_btn, menu_cb, LV_EVENT_CLICKED, nullptr);
+
     // URL input field
     url_input = lv_textarea_create(parent);
     lv_obj_set_size(url_input, LV_HOR_RES - 40, 35);
@@ -455,6 +2253,7 @@ extern "C" void onShow(void *app, void *data, lv_obj_t *parent) {
     lv_textarea_set_placeholder_text(url_input, "Enter URL (e.g., http://example.com)");
     lv_textarea_set_one_line(url_input, true);
     lv_obj_add_event_cb(url_input, url_input_cb, LV_EVENT_READY, nullptr);
+    lv_obj_add_event_cb(url_input, url_changed_cb, LV_EVENT_VALUE_CHANGED, nullptr);
     lv_obj_set_scroll_dir(url_input, LV_DIR_NONE);
 
     // Content container
@@ -468,12 +2267,37 @@ extern "C" void onShow(void *app, void *data, lv_obj_t *parent) {
     lv_obj_set_style_border_width(text_container, 1, 0);
     lv_obj_set_style_border_color(text_container, lv_palette_main(LV_PALETTE_GREY), 0);
 
-    // Text area for content display
-    text_area = lv_textarea_create(text_container);
-    lv_obj_set_size(text_area, lv_pct(100), lv_pct(100));
-    lv_obj_set_pos(text_area, 0, 0);
-    lv_textarea_set_text(text_area, "Enter a URL above to browse the web.");
+    // Gives the container the height of the whole text while the label
+    // only holds the lines around the viewport
+    text_spacer = lv_obj_create(text_container);
+    lv_obj_remove_style_all(text_spacer);
+    lv_obj_set_size(text_spacer, 1, 0);
+    lv_obj_remove_flag(text_spacer, LV_OBJ_FLAG_CLICKABLE);
+    lv_obj_add_event_cb(text_container, text_scroll_cb, LV_EVENT_SCROLL, nullptr);
+
+    // Page text, wrapped to the container width; the container scrolls
+    text_label = lv_label_create(text_container);
+    lv_obj_set_width(text_label, lv_pct(100));
+    lv_label_set_long_mode(text_label, LV_LABEL_LONG_WRAP);
+    loadTextSize();
+    if (text_size >= 0) {
+        lv_obj_set_style_text_font(text_label, kTextFonts[text_size], 0);
+    }
+    showMessage("Enter a URL above to browse the web.");
+
+    createOverlays();
+
+    loadPagedMode();
+    createMenu(parent, focus_btn);
+    createSuggestions(parent);
+    memset(&tabs[0], 0, sizeof(Tab));
+    tab_count = 1;
+    active_tab = 0;
     
+#if TACTILEWEB_BENCHMARK
+    xTaskCreatePinnedToCore(benchmarkTask, "web_bench", 4096, nullptr, tskIDLE_PRIORITY + 1, nullptr, kConverterCore);
+#endif
+
     // Load saved settings
     loadLastUrl();
     lv_textarea_set_text(url_input, initial_url);
@@ -492,19 +2316,50 @@ extern "C" void onShow(void *app, void *data, lv_obj_t *parent) {
 
 extern "C" void onHide(void *app, void *data) {
     // Reset state
+    view_generation++;
     is_loading = false;
+    freePageText();
+    for (size_t i = 0; i < tab_count; i++) {
+        freeTabText(&tabs[i]);
+    }
+    tab_count = 0;
+    active_tab = 0;
+    find_open = false;
+    free(find_matches);
+    find_matches = nullptr;
+    search_generation++;
+    free(search_results);
+    search_results = nullptr;
+    if (url_history && !url_history_save(url_history)) {
+        ESP_LOGW(TAG, "Could not save history");
+    }
     app_handle = nullptr;
     
     // Clear object pointers
     toolbar = nullptr;
     url_input = nullptr;
-    text_area = nullptr;
+    text_label = nullptr;
     text_container = nullptr;
+    text_spacer = nullptr;
     wifi_button = nullptr;
     wifi_card = nullptr;
     loading_label = nullptr;
     retry_button = nullptr;
     status_label = nullptr;
+    menu_list = nullptr;
+    page_mode_item = nullptr;
+    pager_bar = nullptr;
+    pager_label = nullptr;
+    prev_page_button = nullptr;
+    next_page_button = nullptr;
+    find_bar = nullptr;
+    find_input = nullptr;
+    find_count_label = nullptr;
+    popup_list = nullptr;
+    search_input = nullptr;
+    bookmark_item = nullptr;
+    suggest_list = nullptr;
+    memset(suggest_labels, 0, sizeof(suggest_labels));
 }
 
 AppRegistration manifest = {
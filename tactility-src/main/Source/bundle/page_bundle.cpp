@@ -0,0 +1,195 @@
+#include "page_bundle.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if TACTILEWEB_BUNDLE_PARTITION
+#include <esp_partition.h>
+#endif
+
+#include "util/le.h"
+
+constexpr size_t kMaxNameLen = 63;
+
+struct PageBundle {
+    FILE* file;                 // streamed reads, or
+    const uint8_t* mapped;      // the whole bundle in the flash cache
+#if TACTILEWEB_BUNDLE_PARTITION
+    esp_partition_mmap_handle_t mapping;
+#endif
+    size_t size;
+    size_t page_count;
+    uint32_t strings_offset;
+    uint32_t strings_size;
+    char name[kMaxNameLen + 1];
+};
+
+static bool Read(PageBundle* bundle, size_t offset, void* data, size_t len) {
+    if (offset > bundle->size || len > bundle->size - offset) return false;
+    if (bundle->mapped) {
+        memcpy(data, bundle->mapped + offset, len);
+        return true;
+    }
+    return fseek(bundle->file, (long)offset, SEEK_SET) == 0 && fread(data, 1, len, bundle->file) == len;
+}
+
+// Copies a pool string, cut to fit; "" if the offset is bad
+static void ReadString(PageBundle* bundle, uint32_t offset, char* out, size_t size) {
+    out[0] = '\0';
+    if (size == 0 || offset >= bundle->strings_size) return;
+    size_t len = bundle->strings_size - offset < size - 1 ? bundle->strings_size - offset : size - 1;
+    if (!Read(bundle, bundle->strings_offset + offset, out, len)) len = 0;
+    out[len] = '\0';
+}
+
+static bool ReadEntry(PageBundle* bundle, size_t index, uint8_t* entry) {
+    return index < bundle->page_count &&
+           Read(bundle, kPageBundleHeaderSize + index * kPageBundleEntrySize, entry, kPageBundleEntrySize);
+}
+
+// Checks the header and fills in what lookups need
+static bool ReadHeader(PageBundle* bundle) {
+    uint8_t header[kPageBundleHeaderSize];
+    if (!Read(bundle, 0, header, sizeof(header)) || get_le32(header) != kPageBundleMagic ||
+        get_le16(header + 4) != kPageBundleVersion) {
+        return false;
+    }
+    bundle->page_count = get_le16(header + 6);
+    bundle->strings_offset = get_le32(header + 8);
+    bundle->strings_size = get_le32(header + 12);
+    if (bundle->strings_offset > bundle->size || bundle->strings_size > bundle->size - bundle->strings_offset ||
+        kPageBundleHeaderSize + bundle->page_count * kPageBundleEntrySize > bundle->size) {
+        return false;
+    }
+    ReadString(bundle, get_le32(header + 16), bundle->name, sizeof(bundle->name));
+    return true;
+}
+
+PageBundle* page_bundle_open_file(const char* path) {
+    auto* bundle = (PageBundle*)calloc(1, sizeof(PageBundle));
+    if (!bundle) return nullptr;
+    bundle->file = fopen(path, "rb");
+    if (!bundle->file) {
+        free(bundle);
+        return nullptr;
+    }
+    fseek(bundle->file, 0, SEEK_END);
+    long size = ftell(bundle->file);
+    bundle->size = size > 0 ? (size_t)size : 0;
+    if (!ReadHeader(bundle)) {
+        page_bundle_close(bundle);
+        return nullptr;
+    }
+    return bundle;
+}
+
+#if TACTILEWEB_BUNDLE_PARTITION
+PageBundle* page_bundle_open_partition(const char* label) {
+    const esp_partition_t* partition =
+        esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (!partition) return nullptr;
+    auto* bundle = (PageBundle*)calloc(1, sizeof(PageBundle));
+    if (!bundle) return nullptr;
+
+    const void* mapped = nullptr;
+    if (esp_partition_mmap(partition, 0, partition->size, ESP_PARTITION_MMAP_DATA, &mapped, &bundle->mapping) !=
+        ESP_OK) {
+        free(bundle);
+        return nullptr;
+    }
+    bundle->mapped = (const uint8_t*)mapped;
+    bundle->size = partition->size;
+    if (!ReadHeader(bundle)) {
+        page_bundle_close(bundle);
+        return nullptr;
+    }
+    return bundle;
+}
+#endif
+
+void page_bundle_close(PageBundle* bundle) {
+    if (!bundle) return;
+    if (bundle->file) fclose(bundle->file);
+#if TACTILEWEB_BUNDLE_PARTITION
+    if (bundle->mapped) esp_partition_munmap(bundle->mapping);
+#endif
+    free(bundle);
+}
+
+const char* page_bundle_name(const PageBundle* bundle) {
+    return bundle->name;
+}
+
+size_t page_bundle_page_count(const PageBundle* bundle) {
+    return bundle->page_count;
+}
+
+bool page_bundle_find(PageBundle* bundle, const char* path, size_t* index) {
+    size_t low = 0;
+    size_t high = bundle->page_count;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        uint8_t entry[kPageBundleEntrySize];
+        char other[256];
+        if (!ReadEntry(bundle, mid, entry)) return false;
+        ReadString(bundle, get_le32(entry), other, sizeof(other));
+        int order = strcmp(other, path);
+        if (order == 0) {
+            *index = mid;
+            return true;
+        }
+        if (order < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return false;
+}
+
+bool page_bundle_page_info(PageBundle* bundle, size_t index, char* path, size_t path_size, char* title,
+                           size_t title_size) {
+    uint8_t entry[kPageBundleEntrySize];
+    if (!ReadEntry(bundle, index, entry)) return false;
+    ReadString(bundle, get_le32(entry), path, path_size);
+    ReadString(bundle, get_le32(entry + 4), title, title_size);
+    return true;
+}
+
+uint8_t* page_bundle_read_page(PageBundle* bundle, size_t index, size_t* len) {
+    uint8_t entry[kPageBundleEntrySize];
+    if (!ReadEntry(bundle, index, entry)) return nullptr;
+    size_t offset = get_le32(entry + 8);
+    size_t size = get_le32(entry + 12);
+    if (size == 0 || size > bundle->size) return nullptr;
+
+    auto* packed = (uint8_t*)malloc(size);
+    if (packed && !Read(bundle, offset, packed, size)) {
+        free(packed);
+        return nullptr;
+    }
+    *len = size;
+    return packed;
+}
+
+size_t page_bundle_link_count(PageBundle* bundle, size_t index) {
+    uint8_t entry[kPageBundleEntrySize];
+    return ReadEntry(bundle, index, entry) ? get_le16(entry + 20) : 0;
+}
+
+bool page_bundle_link(PageBundle* bundle, size_t index, size_t link_index, PageBundleLink* link) {
+    uint8_t entry[kPageBundleEntrySize];
+    uint8_t record[kPageBundleLinkSize];
+    if (!ReadEntry(bundle, index, entry) || link_index >= get_le16(entry + 20) ||
+        !Read(bundle, get_le32(entry + 16) + link_index * kPageBundleLinkSize, record, sizeof(record))) {
+        return false;
+    }
+    ReadString(bundle, get_le32(record), link->url, sizeof(link->url));
+    ReadString(bundle, get_le32(record + 4), link->label, sizeof(link->label));
+    link->target = (uint16_t)get_le16(record + 8);
+    if (link->target != kPageBundleExternal && link->target >= bundle->page_count) {
+        link->target = kPageBundleExternal;
+    }
+    return link->url[0] != '\0';
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "page_bundle_format.h"
+
+// Offline page bundles: converted pages shipped as one file, built on the
+// host by tools/bundle from HTML with the same html2text engine. A bundle
+// holds a directory of its pages sorted by path, each page packed like a
+// cached one (see page_pack()), each page's link table and one pool of
+// strings.
+//
+// Nothing is loaded up front: lookups binary search the directory where it
+// lies, read from a file a few bytes at a time or, from a flash partition,
+// straight out of its memory mapping. Not thread safe, the app only uses it
+// with the LVGL lock held.
+struct PageBundle;
+
+struct PageBundleLink {
+    uint16_t target;        // page index, or kPageBundleExternal
+    char url[256];          // page path, or the absolute URL
+    char label[64];         // the link's text, "" if it had none
+};
+
+// Opens a bundle file, e.g. on the SD card. nullptr if it isn't one.
+PageBundle* page_bundle_open_file(const char* path);
+
+#if TACTILEWEB_BUNDLE_PARTITION
+// Maps a data partition holding a bundle, e.g. one flashed with the app
+PageBundle* page_bundle_open_partition(const char* label);
+#endif
+
+void page_bundle_close(PageBundle* bundle);
+
+// The bundle's name, as given when it was built
+const char* page_bundle_name(const PageBundle* bundle);
+
+size_t page_bundle_page_count(const PageBundle* bundle);
+
+// Looks up a page by path
+bool page_bundle_find(PageBundle* bundle, const char* path, size_t* index);
+
+bool page_bundle_page_info(PageBundle* bundle, size_t index, char* path, size_t path_size, char* title,
+                           size_t title_size);
+
+// Reads a packed page (caller must free()), nullptr if it's damaged or out
+// of memory
+uint8_t* page_bundle_read_page(PageBundle* bundle, size_t index, size_t* len);
+
+// A page's links, in the order they're numbered on the page
+size_t page_bundle_link_count(PageBundle* bundle, size_t index);
+bool page_bundle_link(PageBundle* bundle, size_t index, size_t link_index, PageBundleLink* link);
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// On-storage layout of a page bundle, shared by the reader and the host
+// tool that builds bundles. Little-endian throughout; offsets are from the
+// start of the bundle, except string offsets, which are into the pool.
+//
+// Header, 24 bytes:
+//   0  magic           u32
+//   4  version         u16
+//   6  page_count      u16
+//   8  strings_offset  u32
+//   12 strings_size    u32
+//   16 name            u32, string
+//   20 reserved        u32
+//
+// Directory, right after the header, one entry per page sorted by path
+// (bytewise):
+//   0  path            u32, string
+//   4  title           u32, string
+//   8  data_offset     u32, the packed page
+//   12 data_size       u32
+//   16 links_offset    u32
+//   20 link_count      u16
+//   22 reserved        u16
+//
+// Link, in the order they're numbered on the page:
+//   0  url             u32, string: page path, or absolute URL
+//   4  label           u32, string
+//   8  target          u16, page index or kPageBundleExternal
+//   10 reserved        u16
+//
+// Strings are NUL-terminated, paths relative to the bundle's root.
+constexpr uint32_t kPageBundleMagic = 0x44425754;   // "TWBD"
+constexpr uint16_t kPageBundleVersion = 1;
+constexpr size_t kPageBundleHeaderSize = 24;
+constexpr size_t kPageBundleEntrySize = 24;
+constexpr size_t kPageBundleLinkSize = 12;
+constexpr uint16_t kPageBundleExternal = 0xFFFF;
@@ -0,0 +1,316 @@
+#include "page_cache.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "util/ascii.h"
+#include "util/le.h"
+
+// Segment files are named by sequence number, 8.3 so they suit FAT too.
+// A record is a 16 byte header, the key and the value. The CRC covers
+// everything after it. All fields are little-endian.
+//
+//   0  magic      u32
+//   4  crc        u32
+//   8  key_len    u16
+//   10 reserved   u16
+//   12 value_len  u32
+constexpr uint32_t kMagic = 0x43505754;    // "TWPC"
+constexpr size_t kHeaderSize = 16;
+constexpr size_t kMaxKeyLen = 255;
+constexpr size_t kMaxEntries = 128;
+
+struct Entry {
+    uint32_t hash;
+    uint32_t segment;
+    uint32_t offset;
+    uint32_t size;      // of the whole record
+    bool used;          // read since its segment was last compacted
+};
+
+struct PageCache {
+    char dir[128];
+    size_t segment_size;
+    size_t max_segments;
+    SemaphoreHandle_t lock;
+    Entry entries[kMaxEntries];
+    size_t entry_count;
+    uint32_t first_segment;     // oldest that may exist
+    uint32_t last_segment;      // the one appended to
+    FILE* tail;                 // nullptr until last_segment, a fresh one, opens
+    size_t tail_size;
+};
+
+static uint32_t HashKey(const char* key, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (uint8_t)key[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static void SegmentPath(const PageCache* cache, uint32_t segment, char* path, size_t size) {
+    snprintf(path, size, "%s/%08lx.log", cache->dir, (unsigned long)segment);
+}
+
+// Points the key at a record; at capacity the entry for the oldest record
+// makes room
+static void IndexRecord(PageCache* cache, uint32_t hash, uint32_t segment, uint32_t offset, uint32_t size) {
+    Entry* entry = nullptr;
+    for (size_t i = 0; i < cache->entry_count && !entry; i++) {
+        if (cache->entries[i].hash == hash) entry = &cache->entries[i];
+    }
+    if (!entry && cache->entry_count < kMaxEntries) {
+        entry = &cache->entries[cache->entry_count++];
+    }
+    if (!entry) {
+        entry = &cache->entries[0];
+        for (size_t i = 1; i < kMaxEntries; i++) {
+            const Entry* other = &cache->entries[i];
+            if (other->segment < entry->segment || (other->segment == entry->segment && other->offset < entry->offset)) {
+                entry = &cache->entries[i];
+            }
+        }
+    }
+    *entry = {hash, segment, offset, size, false};
+}
+
+static void DropEntry(PageCache* cache, Entry* entry) {
+    *entry = cache->entries[--cache->entry_count];
+}
+
+// Indexes a segment's records and returns where the valid ones end
+static size_t ScanSegment(PageCache* cache, uint32_t segment, bool* torn) {
+    char path[160];
+    SegmentPath(cache, segment, path, sizeof(path));
+    FILE* file = fopen(path, "rb");
+    *torn = false;
+    if (!file) return 0;
+
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    size_t offset = 0;
+    uint8_t header[kHeaderSize];
+    char key[kMaxKeyLen];
+    while (fseek(file, (long)offset, SEEK_SET) == 0 && fread(header, 1, kHeaderSize, file) == kHeaderSize) {
+        size_t key_len = get_le16(header + 8);
+        size_t value_len = get_le32(header + 12);
+        size_t size = kHeaderSize + key_len + value_len;
+        if (get_le32(header) != kMagic || key_len == 0 || key_len > kMaxKeyLen || value_len > cache->segment_size ||
+            offset + size > (size_t)file_size || fread(key, 1, key_len, file) != key_len) {
+            break;
+        }
+        // The CRC is checked when the record is read
+        IndexRecord(cache, HashKey(key, key_len), segment, (uint32_t)offset, (uint32_t)size);
+        offset += size;
+    }
+    *torn = offset != (size_t)file_size;
+    fclose(file);
+    return offset;
+}
+
+static bool OpenTail(PageCache* cache, const char* mode) {
+    char path[160];
+    SegmentPath(cache, cache->last_segment, path, sizeof(path));
+    cache->tail = fopen(path, mode);
+    return cache->tail != nullptr;
+}
+
+// Closes the tail for the next put to start a fresh segment
+static void EndSegment(PageCache* cache) {
+    if (cache->tail) fclose(cache->tail);
+    cache->tail = nullptr;
+    cache->last_segment++;
+    cache->tail_size = 0;
+}
+
+// A failed write may have left part of the record behind, and nothing can
+// follow it at a known offset, so the segment ends there
+static bool Append(PageCache* cache, const uint8_t* record, size_t size) {
+    if (!cache->tail) return false;
+    if (fwrite(record, 1, size, cache->tail) != size || fflush(cache->tail) != 0) {
+        EndSegment(cache);
+        return false;
+    }
+    fsync(fileno(cache->tail));
+    cache->tail_size += size;
+    return true;
+}
+
+// Reads an entry's whole record (caller must free()) and checks its CRC
+static uint8_t* ReadRecord(PageCache* cache, const Entry* entry) {
+    char path[160];
+    SegmentPath(cache, entry->segment, path, sizeof(path));
+    FILE* file = fopen(path, "rb");
+    if (!file) return nullptr;
+
+    auto* record = (uint8_t*)malloc(entry->size);
+    bool ok = record && fseek(file, (long)entry->offset, SEEK_SET) == 0 &&
+              fread(record, 1, entry->size, file) == entry->size && get_le32(record) == kMagic &&
+              kHeaderSize + get_le16(record + 8) + get_le32(record + 12) == entry->size &&
+              get_le32(record + 4) == crc32_update(0, record + 8, entry->size - 8);
+    fclose(file);
+    if (!ok) {
+        free(record);
+        return nullptr;
+    }
+    return record;
+}
+
+// Moves the entries read since the last pass out of the oldest segment,
+// drops the rest and deletes it
+static void CompactOldest(PageCache* cache) {
+    uint32_t segment = cache->first_segment;
+    for (size_t i = 0; i < cache->entry_count;) {
+        Entry* entry = &cache->entries[i];
+        if (entry->segment != segment) {
+            i++;
+            continue;
+        }
+        uint8_t* record = entry->used ? ReadRecord(cache, entry) : nullptr;
+        uint32_t offset = (uint32_t)cache->tail_size;
+        if (record && Append(cache, record, entry->size)) {
+            entry->segment = cache->last_segment;
+            entry->offset = offset;
+            entry->used = false;
+            i++;
+        } else {
+            DropEntry(cache, entry);
+        }
+        free(record);
+    }
+
+    char path[160];
+    SegmentPath(cache, segment, path, sizeof(path));
+    remove(path);
+    cache->first_segment++;
+}
+
+PageCache* page_cache_open(const char* dir, size_t segment_size, size_t max_segments) {
+    auto* cache = (PageCache*)calloc(1, sizeof(PageCache));
+    if (!cache) return nullptr;
+    cache->lock = xSemaphoreCreateMutex();
+    if (!cache->lock || strlen(dir) >= sizeof(cache->dir)) {
+        page_cache_close(cache);
+        return nullptr;
+    }
+    strcpy(cache->dir, dir);
+    cache->segment_size = segment_size;
+    cache->max_segments = max_segments > 1 ? max_segments : 2;
+    mkdir(dir, 0775);
+
+    // Find the range of segments left by earlier runs
+    bool found = false;
+    DIR* listing = opendir(dir);
+    if (listing) {
+        while (struct dirent* item = readdir(listing)) {
+            unsigned long segment = 0;
+            char ext[4] = "";
+            if (sscanf(item->d_name, "%8lx.%3s", &segment, ext) != 2 || ascii_casecmp(ext, "log") != 0) continue;
+            if (!found || segment < cache->first_segment) cache->first_segment = (uint32_t)segment;
+            if (!found || segment > cache->last_segment) cache->last_segment = (uint32_t)segment;
+            found = true;
+        }
+        closedir(listing);
+    }
+
+    // Oldest first, so later records of a key win
+    bool torn = false;
+    for (uint32_t segment = cache->first_segment; found; segment++) {
+        cache->tail_size = ScanSegment(cache, segment, &torn);
+        if (segment == cache->last_segment) break;
+    }
+
+    // Never append after a damaged record, its length can't be trusted
+    if (found && torn) {
+        cache->last_segment++;
+        cache->tail_size = 0;
+    }
+    if (!OpenTail(cache, found && !torn ? "ab" : "wb")) {
+        page_cache_close(cache);
+        return nullptr;
+    }
+    return cache;
+}
+
+void page_cache_close(PageCache* cache) {
+    if (!cache) return;
+    if (cache->tail) fclose(cache->tail);
+    if (cache->lock) vSemaphoreDelete(cache->lock);
+    free(cache);
+}
+
+bool page_cache_put(PageCache* cache, const char* key, const void* value, size_t len) {
+    size_t key_len = strlen(key);
+    size_t size = kHeaderSize + key_len + len;
+    if (key_len == 0 || key_len > kMaxKeyLen || size > cache->segment_size) return false;
+
+    auto* record = (uint8_t*)malloc(size);
+    if (!record) return false;
+    put_le32(record, kMagic);
+    put_le16(record + 8, (uint32_t)key_len);
+    put_le16(record + 10, 0);
+    put_le32(record + 12, (uint32_t)len);
+    memcpy(record + kHeaderSize, key, key_len);
+    memcpy(record + kHeaderSize + key_len, value, len);
+    put_le32(record + 4, crc32_update(0, record + 8, size - 8));
+
+    xSemaphoreTake(cache->lock, portMAX_DELAY);
+    if (cache->tail && cache->tail_size > 0 && cache->tail_size + size > cache->segment_size) {
+        EndSegment(cache);
+    }
+    // Also retries a segment that failed to open or to take a write before
+    if (!cache->tail && OpenTail(cache, "wb")) {
+        // Records copied forward may overfill the new segment a little
+        while (cache->tail && cache->last_segment - cache->first_segment >= cache->max_segments) {
+            CompactOldest(cache);
+        }
+    }
+    uint32_t offset = (uint32_t)cache->tail_size;
+    bool ok = Append(cache, record, size);
+    if (ok) {
+        IndexRecord(cache, HashKey(key, key_len), cache->last_segment, offset, (uint32_t)size);
+    }
+    xSemaphoreGive(cache->lock);
+
+    free(record);
+    return ok;
+}
+
+void* page_cache_get(PageCache* cache, const char* key, size_t* len) {
+    size_t key_len = strlen(key);
+    uint32_t hash = HashKey(key, key_len);
+
+    xSemaphoreTake(cache->lock, portMAX_DELAY);
+    uint8_t* record = nullptr;
+    for (size_t i = 0; i < cache->entry_count; i++) {
+        Entry* entry = &cache->entries[i];
+        if (entry->hash != hash) continue;
+        record = ReadRecord(cache, entry);
+        if (!record) {
+            DropEntry(cache, entry);
+        } else if (get_le16(record + 8) != key_len || memcmp(record + kHeaderSize, key, key_len) != 0) {
+            // Another key with the same hash
+            free(record);
+            record = nullptr;
+        } else {
+            entry->used = true;
+        }
+        break;
+    }
+    xSemaphoreGive(cache->lock);
+    if (!record) return nullptr;
+
+    *len = get_le32(record + 12);
+    memmove(record, record + kHeaderSize + key_len, *len);
+    return record;
+}
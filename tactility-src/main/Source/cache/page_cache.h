@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+
+// Key/value cache on flash, written as a log so flash only ever sees
+// appends and whole-file deletes, never a rewrite in place. Records go to
+// the end of the newest segment file; once a segment is full the next one
+// is started, and when there are more than max_segments the oldest is
+// compacted: entries read since it was last compacted are copied forward,
+// the rest are dropped, and the file is deleted.
+//
+// The index of where each key's latest record is lives in RAM and is
+// rebuilt from the record headers on open. Every record carries a CRC,
+// checked when it's read; a record torn by a crash or power loss ends the
+// scan of its segment, and writing continues in a new one.
+//
+// All calls may block on flash and are safe from any task. Keep them off
+// the UI task, except for short reads.
+struct PageCache;
+
+// Opens the cache in dir, creating the directory if needed
+PageCache* page_cache_open(const char* dir, size_t segment_size, size_t max_segments);
+void page_cache_close(PageCache* cache);
+
+// Stores a value, replacing the key's earlier one. Returns false if the
+// record is larger than a segment or can't be written.
+bool page_cache_put(PageCache* cache, const char* key, const void* value, size_t len);
+
+// Reads a key's value (caller must free()), nullptr if it isn't cached or
+// its record is damaged
+void* page_cache_get(PageCache* cache, const char* key, size_t* len);
@@ -0,0 +1,65 @@
+#include "page_pack.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include "text_compress.h"
+#include "util/le.h"
+
+// Each heading is its offset (32 bits), its level and 3 zero bytes
+constexpr size_t kHeadingSize = 8;
+
+uint8_t* page_pack(const char* text, const Html2TextHeading* headings, size_t heading_count, size_t* len) {
+    size_t text_len = strlen(text);
+    size_t table = 2 + heading_count * kHeadingSize;
+    size_t bound = table + text_compress_bound(text_len);
+    auto* packed = (uint8_t*)malloc(bound);
+    if (!packed) return nullptr;
+
+    put_le16(packed, (uint32_t)heading_count);
+    for (size_t i = 0; i < heading_count; i++) {
+        uint8_t* at = packed + 2 + i * kHeadingSize;
+        put_le32(at, headings[i].offset);
+        at[4] = headings[i].level;
+        memset(at + 5, 0, kHeadingSize - 5);
+    }
+    size_t block = text_compress(text, text_len, packed + table, bound - table);
+    if (block == 0) {
+        free(packed);
+        return nullptr;
+    }
+    *len = table + block;
+    auto* shrunk = (uint8_t*)realloc(packed, *len);
+    return shrunk ? shrunk : packed;
+}
+
+char* page_unpack(const uint8_t* packed, size_t len, Html2TextHeading** headings, size_t* heading_count) {
+    if (len < 2) return nullptr;
+    size_t count = get_le16(packed);
+    size_t table = 2 + count * kHeadingSize;
+    size_t text_len = 0;
+    if (len < table || !text_compress_peek_length(packed + table, len - table, &text_len)) return nullptr;
+
+    auto* text = (char*)malloc(text_len + 1);
+    auto* table_copy = count > 0 ? (Html2TextHeading*)malloc(count * sizeof(Html2TextHeading)) : nullptr;
+    if (!text || (count > 0 && !table_copy) || !text_decompress(packed + table, len - table, text, text_len + 1)) {
+        free(text);
+        free(table_copy);
+        return nullptr;
+    }
+    // Bundles and cache records come from storage; a heading must point
+    // into the text and have a level the outline can indent
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t* at = packed + 2 + i * kHeadingSize;
+        table_copy[i].offset = get_le32(at);
+        table_copy[i].level = at[4];
+        if (table_copy[i].level < 1 || table_copy[i].level > 6 || table_copy[i].offset > text_len) {
+            free(text);
+            free(table_copy);
+            return nullptr;
+        }
+    }
+    *headings = table_copy;
+    *heading_count = count;
+    return text;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "html2text/html2text.h"
+
+// A converted page packed for keeping: the heading count (16 bits), the
+// headings and the text, without soft breaks, as a text_compress() block.
+// Background tabs, the page cache and offline bundles all hold pages this
+// way. All fields are little-endian.
+
+// Returns the packed page (caller must free()), nullptr when out of memory
+uint8_t* page_pack(const char* text, const Html2TextHeading* headings, size_t heading_count, size_t* len);
+
+// Returns the page's text (caller must free()) and hands over its headings,
+// nullptr if it's damaged, a heading included, or out of memory
+char* page_unpack(const uint8_t* packed, size_t len, Html2TextHeading** headings, size_t* heading_count);
@@ -0,0 +1,195 @@
+#include "text_compress.h"
+
+#include <cstdlib>
+
+// Tokens, most significant bit first: a 1 and the byte for a literal, or a
+// 0, the distance - 1 and the length - kMinMatch for a copy of earlier text.
+// A literal costs 9 bits and a copy 16, so copies start at 3 bytes.
+constexpr unsigned kWindowBits = 11;
+constexpr unsigned kLengthBits = 4;
+constexpr size_t kWindow = (size_t)1 << kWindowBits;
+constexpr size_t kMinMatch = 3;
+constexpr size_t kMaxMatch = kMinMatch + ((size_t)1 << kLengthBits) - 1;
+
+// Encoder match finder: hash heads and chains of earlier positions with the
+// same hash, both as the low 16 bits of the position. The window is far
+// below 64 KB, so a distance computed from those bits is exact while it's
+// in the window; stale entries only cost a compare.
+constexpr unsigned kHashBits = 9;
+constexpr unsigned kMaxChain = 16;
+
+struct BitWriter {
+    uint8_t* out;
+    size_t size;
+    size_t pos;
+    uint32_t bits;
+    unsigned count;
+    bool overflow;
+};
+
+static void PutBits(BitWriter* w, uint32_t value, unsigned n) {
+    w->bits = (w->bits << n) | value;
+    w->count += n;
+    while (w->count >= 8) {
+        w->count -= 8;
+        if (w->pos == w->size) {
+            w->overflow = true;
+            return;
+        }
+        w->out[w->pos++] = (uint8_t)(w->bits >> w->count);
+    }
+}
+
+static uint32_t Hash(const uint8_t* p) {
+    uint32_t v = (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2];
+    return (v * 2654435761u) >> (32 - kHashBits);
+}
+
+size_t text_compress_bound(size_t len) {
+    return 10 + (len * 9 + 7) / 8;
+}
+
+size_t text_compress(const char* text, size_t len, uint8_t* out, size_t out_size) {
+    auto* head = (uint16_t*)calloc((size_t)1 << kHashBits, sizeof(uint16_t));
+    auto* chain = (uint16_t*)calloc(kWindow, sizeof(uint16_t));
+    if (!head || !chain) {
+        free(head);
+        free(chain);
+        return 0;
+    }
+
+    BitWriter w = {out, out_size, 0, 0, 0, false};
+    for (size_t rest = len; ; rest >>= 7) {
+        PutBits(&w, (uint32_t)(rest & 0x7F) | (rest >= 0x80 ? 0x80 : 0), 8);
+        if (rest < 0x80) break;
+    }
+
+    const auto* bytes = (const uint8_t*)text;
+    size_t pos = 0;
+    while (pos < len && !w.overflow) {
+        size_t best_len = 0;
+        size_t best_dist = 0;
+        if (pos + kMinMatch <= len) {
+            uint32_t hash = Hash(bytes + pos);
+            size_t max = len - pos < kMaxMatch ? len - pos : kMaxMatch;
+            size_t dist = (uint16_t)(pos - head[hash]);
+            for (unsigned depth = 0; depth < kMaxChain; depth++) {
+                if (dist == 0 || dist > kWindow || dist > pos) break;
+                const uint8_t* candidate = bytes + pos - dist;
+                size_t n = 0;
+                while (n < max && candidate[n] == bytes[pos + n]) n++;
+                if (n > best_len) {
+                    best_len = n;
+                    best_dist = dist;
+                    if (n == max) break;
+                }
+                // Chains only lead further back
+                size_t next = (uint16_t)(pos - chain[(pos - dist) & (kWindow - 1)]);
+                if (next <= dist) break;
+                dist = next;
+            }
+        }
+
+        size_t step = best_len >= kMinMatch ? best_len : 1;
+        if (step > 1) {
+            PutBits(&w, (uint32_t)(best_dist - 1) << kLengthBits | (uint32_t)(best_len - kMinMatch),
+                    1 + kWindowBits + kLengthBits);
+        } else {
+            PutBits(&w, 0x100 | bytes[pos], 9);
+        }
+        for (size_t end = pos + step; pos < end; pos++) {
+            if (pos + kMinMatch <= len) {
+                uint32_t hash = Hash(bytes + pos);
+                chain[pos & (kWindow - 1)] = head[hash];
+                head[hash] = (uint16_t)pos;
+            }
+        }
+    }
+    if (w.count > 0) {
+        PutBits(&w, 0, 8 - w.count);
+    }
+
+    free(head);
+    free(chain);
+    return w.overflow ? 0 : w.pos;
+}
+
+bool text_compress_peek_length(const uint8_t* block, size_t len, size_t* text_len) {
+    size_t value = 0;
+    for (size_t i = 0; i < len && i < 5; i++) {
+        value |= (size_t)(block[i] & 0x7F) << (7 * i);
+        if ((block[i] & 0x80) == 0) {
+            *text_len = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+void text_decoder_init(TextDecoder* dec, char* out, size_t out_size) {
+    *dec = {};
+    dec->out = out;
+    dec->out_size = out_size;
+}
+
+bool text_decoder_feed(TextDecoder* dec, const uint8_t* in, size_t len) {
+    for (size_t i = 0; i < len && !dec->failed; i++) {
+        uint8_t byte = in[i];
+        if (!dec->header_done) {
+            dec->text_len |= (size_t)(byte & 0x7F) << dec->header_shift;
+            dec->header_shift = (uint8_t)(dec->header_shift + 7);
+            if ((byte & 0x80) == 0) {
+                dec->header_done = true;
+                dec->failed = dec->text_len >= dec->out_size;
+            } else {
+                dec->failed = dec->header_shift >= 35;
+            }
+            continue;
+        }
+
+        // At most 15 bits are left over from the previous byte
+        dec->bits = dec->bits << 8 | byte;
+        dec->bit_count = (uint8_t)(dec->bit_count + 8);
+        while (dec->out_len < dec->text_len && dec->bit_count > 0) {
+            unsigned count = dec->bit_count;
+            if ((dec->bits >> (count - 1)) & 1) {
+                if (count < 9) break;
+                dec->out[dec->out_len++] = (char)(dec->bits >> (count - 9));
+                dec->bit_count = (uint8_t)(count - 9);
+            } else {
+                if (count < 1 + kWindowBits + kLengthBits) break;
+                count -= 1 + kWindowBits + kLengthBits;
+                uint32_t token = dec->bits >> count;
+                size_t dist = ((token >> kLengthBits) & (kWindow - 1)) + 1;
+                size_t n = (token & (((size_t)1 << kLengthBits) - 1)) + kMinMatch;
+                dec->bit_count = (uint8_t)count;
+                if (dist > dec->out_len || n > dec->text_len - dec->out_len) {
+                    dec->failed = true;
+                    break;
+                }
+                // Byte by byte, a copy may overlap what it writes
+                char* dst = dec->out + dec->out_len;
+                const char* src = dst - dist;
+                for (size_t k = 0; k < n; k++) {
+                    dst[k] = src[k];
+                }
+                dec->out_len += n;
+            }
+        }
+    }
+
+    if (!dec->failed && text_decoder_done(dec)) {
+        dec->out[dec->out_len] = '\0';
+    }
+    return !dec->failed;
+}
+
+bool text_decoder_done(const TextDecoder* dec) {
+    return dec->header_done && !dec->failed && dec->out_len == dec->text_len;
+}
+
+bool text_decompress(const uint8_t* block, size_t len, char* out, size_t out_size) {
+    TextDecoder dec;
+    text_decoder_init(&dec, out, out_size);
+    return text_decoder_feed(&dec, block, len) && text_decoder_done(&dec);
+}
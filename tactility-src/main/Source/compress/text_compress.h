@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// LZSS compression for converted page text, in the manner of heatshrink: a
+// 2 KB window, byte literals and short back-references packed as bit
+// tokens. Prose shrinks to roughly half, the decoder keeps a few words of
+// state and uses its output as the window, so text can be unpacked straight
+// into the buffer it's read from, fed in chunks as they come off flash.
+//
+// A block starts with the text length as a varint, then the tokens.
+
+// Largest block text_compress() can produce for len bytes of text
+size_t text_compress_bound(size_t len);
+
+// Compresses into out and returns the block size, 0 if it didn't fit in
+// out_size or the encoder's tables (5 KB, freed before returning) couldn't
+// be allocated
+size_t text_compress(const char* text, size_t len, uint8_t* out, size_t out_size);
+
+// Reads the text length from the start of a block; false if the header is
+// incomplete or bad
+bool text_compress_peek_length(const uint8_t* block, size_t len, size_t* text_len);
+
+struct TextDecoder {
+    char* out;
+    size_t out_size;
+    size_t out_len;
+    size_t text_len;
+    uint32_t bits;          // pending token bits, low `bit_count` valid
+    uint8_t bit_count;
+    uint8_t header_shift;
+    bool header_done;
+    bool failed;
+};
+
+// Decodes into out, which needs room for the text and a NUL
+void text_decoder_init(TextDecoder* dec, char* out, size_t out_size);
+
+// Decodes the next part of a block. Returns false once the block proved
+// bad or too large for the output.
+bool text_decoder_feed(TextDecoder* dec, const uint8_t* in, size_t len);
+
+// True once the whole text is out (and NUL-terminated)
+bool text_decoder_done(const TextDecoder* dec);
+
+// Decodes a whole block; out_size must exceed the text length
+bool text_decompress(const uint8_t* block, size_t len, char* out, size_t out_size);
@@ -0,0 +1,58 @@
+#include "text_find.h"
+
+struct FoldTable {
+    uint8_t map[256];
+};
+
+static constexpr FoldTable BuildFoldTable() {
+    FoldTable table = {};
+    for (int c = 0; c < 256; c++) {
+        uint8_t folded = (uint8_t)c;
+        if (c >= 'A' && c <= 'Z') folded = (uint8_t)(c | 0x20);
+        if (c == '\n' || c == '\t' || c == '\r') folded = ' ';
+        table.map[c] = folded;
+    }
+    return table;
+}
+
+static constexpr FoldTable kFold = BuildFoldTable();
+
+bool text_find_compile(TextFind* find, const char* pattern, size_t len) {
+    if (len == 0 || len > kTextFindMaxLen) return false;
+
+    find->len = len;
+    for (size_t i = 0; i < len; i++) {
+        find->pattern[i] = kFold.map[(uint8_t)pattern[i]];
+    }
+    // How far the window may move when its last byte is c
+    for (size_t c = 0; c < 256; c++) {
+        find->shift[c] = (uint8_t)len;
+    }
+    for (size_t i = 0; i + 1 < len; i++) {
+        find->shift[find->pattern[i]] = (uint8_t)(len - 1 - i);
+    }
+    return true;
+}
+
+size_t text_find_all(const TextFind* find, const char* text, size_t len, uint32_t* matches, size_t max_matches) {
+    const size_t m = find->len;
+    const uint8_t* bytes = (const uint8_t*)text;
+    const uint8_t last = find->pattern[m - 1];
+
+    size_t count = 0;
+    size_t pos = 0;
+    while (count < max_matches && pos + m <= len) {
+        uint8_t tail = kFold.map[bytes[pos + m - 1]];
+        if (tail == last) {
+            size_t i = 0;
+            while (i + 1 < m && kFold.map[bytes[pos + i]] == find->pattern[i]) i++;
+            if (i + 1 == m) {
+                matches[count++] = (uint32_t)pos;
+                pos += m;
+                continue;
+            }
+        }
+        pos += find->shift[tail];
+    }
+    return count;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Substring search over converted page text (Boyer-Moore-Horspool). ASCII
+// letters match case-insensitively and any whitespace matches any other, so
+// a phrase is found across line breaks. Other bytes must match exactly,
+// which keeps UTF-8 safe: a pattern starts with a lead byte, and a lead
+// byte never matches inside a multi-byte character.
+
+constexpr size_t kTextFindMaxLen = 64;
+
+struct TextFind {
+    uint8_t pattern[kTextFindMaxLen];   // folded
+    size_t len;
+    uint8_t shift[256];                 // by folded byte
+};
+
+// Prepares a search; returns false for an empty or too long pattern
+bool text_find_compile(TextFind* find, const char* pattern, size_t len);
+
+// Stores the offsets of non-overlapping matches in order and returns their
+// count, at most max_matches
+size_t text_find_all(const TextFind* find, const char* text, size_t len, uint32_t* matches, size_t max_matches);
@@ -0,0 +1,401 @@
+#include "url_history.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+
+#include "util/ascii.h"
+#include "util/le.h"
+
+// The file is a 12 byte header and the entries, in key order. Each is a
+// 12 byte header, then the URL and the title. Little-endian throughout.
+//
+//   0  magic       u32
+//   4  clock       u32
+//   8  count       u16
+//   10 reserved    u16
+//
+//   entry: flags u8, url_len u8, title_len u8, reserved u8, score u32, last u32
+constexpr uint32_t kMagic = 0x48555754;     // "TWUH"
+constexpr size_t kHeaderSize = 12;
+constexpr size_t kEntryHeaderSize = 12;
+constexpr size_t kArenaSize = 8 * 1024;
+constexpr size_t kMaxUrlLen = 255;
+constexpr size_t kMaxTitleLen = 63;
+constexpr uint32_t kVisitScore = 100;
+constexpr uint32_t kBookmarkBonus = 1u << 24;
+constexpr uint8_t kBookmarked = 0x01;
+
+struct Entry {
+    uint16_t offset;        // of the URL in the arena; the title follows it
+    uint8_t url_len;
+    uint8_t key_skip;       // scheme and "www." in front of the key
+    uint8_t title_len;
+    uint8_t flags;
+    uint32_t score;         // as of last
+    uint32_t last;          // clock at the last visit
+};
+
+struct UrlHistory {
+    char path[160];
+    Entry entries[kUrlHistoryMaxEntries];
+    size_t count;
+    char* arena;            // NUL-terminated URLs and titles
+    size_t arena_used;
+    uint32_t clock;         // counts visits
+    bool dirty;
+};
+
+// Length of the scheme and "www." in front of a URL's key
+static size_t KeySkip(const char* url) {
+    size_t skip = 0;
+    if (ascii_ncasecmp(url, "https://", 8) == 0) {
+        skip = 8;
+    } else if (ascii_ncasecmp(url, "http://", 7) == 0) {
+        skip = 7;
+    }
+    if (ascii_ncasecmp(url + skip, "www.", 4) == 0) skip += 4;
+    return skip;
+}
+
+// Like strncmp on keys, but the host matches in any case. Paths don't:
+// example.com/Foo and example.com/foo may be different pages.
+static int CompareKeys(const char* a, const char* b, size_t n) {
+    bool host = true;
+    for (size_t i = 0; i < n; i++) {
+        auto ca = (unsigned char)(host ? ascii_lower(a[i]) : a[i]);
+        auto cb = (unsigned char)(host ? ascii_lower(b[i]) : b[i]);
+        if (ca != cb) return ca - cb;
+        if (ca == '\0') return 0;
+        if (ca == '/' || ca == '?' || ca == '#') host = false;
+    }
+    return 0;
+}
+
+static const char* Url(const UrlHistory* history, const Entry* entry) {
+    return history->arena + entry->offset;
+}
+
+static const char* Key(const UrlHistory* history, const Entry* entry) {
+    return Url(history, entry) + entry->key_skip;
+}
+
+static const char* Title(const UrlHistory* history, const Entry* entry) {
+    return Url(history, entry) + entry->url_len + 1;
+}
+
+static uint32_t Frecency(const UrlHistory* history, const Entry* entry) {
+    uint32_t halvings = (history->clock - entry->last) / kUrlHistoryHalfLife;
+    uint32_t score = halvings < 32 ? entry->score >> halvings : 0;
+    return (entry->flags & kBookmarked) ? score + kBookmarkBonus : score;
+}
+
+// Index of the first entry whose key isn't below key
+static size_t LowerBound(const UrlHistory* history, const char* key) {
+    size_t low = 0;
+    size_t high = history->count;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        if (CompareKeys(Key(history, &history->entries[mid]), key, SIZE_MAX) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+static Entry* Find(const UrlHistory* history, const char* url) {
+    const char* key = url + KeySkip(url);
+    size_t at = LowerBound(history, key);
+    if (at < history->count && CompareKeys(Key(history, &history->entries[at]), key, SIZE_MAX) == 0) {
+        return const_cast<Entry*>(&history->entries[at]);
+    }
+    return nullptr;
+}
+
+// Copies the live strings into a fresh arena, dropping those of removed
+// or updated entries
+static bool CompactArena(UrlHistory* history) {
+    auto* arena = (char*)malloc(kArenaSize);
+    if (!arena) return false;
+    size_t used = 0;
+    for (size_t i = 0; i < history->count; i++) {
+        Entry* entry = &history->entries[i];
+        size_t len = entry->url_len + entry->title_len + 2u;
+        memcpy(arena + used, Url(history, entry), len);
+        entry->offset = (uint16_t)used;
+        used += len;
+    }
+    free(history->arena);
+    history->arena = arena;
+    history->arena_used = used;
+    return true;
+}
+
+// Drops the history entry with the lowest score; false if all are bookmarks
+static bool DropWorst(UrlHistory* history) {
+    size_t worst = history->count;
+    for (size_t i = 0; i < history->count; i++) {
+        const Entry* entry = &history->entries[i];
+        if ((entry->flags & kBookmarked) == 0 &&
+            (worst == history->count || Frecency(history, entry) < Frecency(history, &history->entries[worst]))) {
+            worst = i;
+        }
+    }
+    if (worst == history->count) return false;
+    memmove(&history->entries[worst], &history->entries[worst + 1], (history->count - worst - 1) * sizeof(Entry));
+    history->count--;
+    return true;
+}
+
+// Stores the URL and title in the arena, making room if needed; false if
+// there's none to make
+static bool Store(UrlHistory* history, Entry* entry, const char* url, size_t url_len, const char* title,
+                  size_t title_len) {
+    size_t len = url_len + title_len + 2;
+    if (history->arena_used + len > kArenaSize) {
+        CompactArena(history);
+    }
+    if (history->arena_used + len > kArenaSize) return false;
+    char* at = history->arena + history->arena_used;
+    memcpy(at, url, url_len);
+    at[url_len] = '\0';
+    memcpy(at + url_len + 1, title, title_len);
+    at[url_len + 1 + title_len] = '\0';
+    entry->offset = (uint16_t)history->arena_used;
+    entry->url_len = (uint8_t)url_len;
+    entry->key_skip = (uint8_t)KeySkip(url);
+    entry->title_len = (uint8_t)title_len;
+    history->arena_used += len;
+    return true;
+}
+
+// Cuts a title to fit, not leaving half a UTF-8 character at the end
+static size_t TitleLength(const char* title) {
+    size_t len = strnlen(title, kMaxTitleLen + 1);
+    if (len > kMaxTitleLen) {
+        len = kMaxTitleLen;
+        while (len > 0 && ((uint8_t)title[len] & 0xC0) == 0x80) len--;
+    }
+    return len;
+}
+
+// Finds or adds the URL's entry, with the URL and title given. nullptr if
+// the URL is too long or there's no room.
+static Entry* Upsert(UrlHistory* history, const char* url, const char* title) {
+    size_t url_len = strlen(url);
+    size_t title_len = TitleLength(title);
+    if (url_len == 0 || url_len > kMaxUrlLen || KeySkip(url) == url_len) return nullptr;
+
+    Entry* entry = Find(history, url);
+    if (entry) {
+        // The scheme, the case of the host or the title may have changed;
+        // keep the old title if there's no new one
+        if (title_len == 0 && entry->title_len > 0) {
+            title = Title(history, entry);
+            title_len = entry->title_len;
+        }
+        if (strcmp(Url(history, entry), url) == 0 && title_len == entry->title_len &&
+            memcmp(Title(history, entry), title, title_len) == 0) {
+            return entry;
+        }
+        // Compacting the arena moves the old title. Without room the entry
+        // keeps its old URL and title.
+        char copy[kMaxTitleLen + 1];
+        memcpy(copy, title, title_len);
+        Store(history, entry, url, url_len, copy, title_len);
+        return entry;
+    }
+
+    size_t needed = url_len + title_len + 2;
+    while (history->count == kUrlHistoryMaxEntries ||
+           (history->arena_used + needed > kArenaSize && CompactArena(history) &&
+            history->arena_used + needed > kArenaSize)) {
+        if (!DropWorst(history)) return nullptr;
+    }
+
+    size_t at = LowerBound(history, url + KeySkip(url));
+    memmove(&history->entries[at + 1], &history->entries[at], (history->count - at) * sizeof(Entry));
+    history->count++;
+    entry = &history->entries[at];
+    *entry = {};
+    entry->last = history->clock;
+    if (!Store(history, entry, url, url_len, title, title_len)) {
+        memmove(&history->entries[at], &history->entries[at + 1], (history->count - at - 1) * sizeof(Entry));
+        history->count--;
+        return nullptr;
+    }
+    return entry;
+}
+
+static bool Load(UrlHistory* history) {
+    FILE* file = fopen(history->path, "rb");
+    if (!file) return false;
+
+    uint8_t header[kHeaderSize];
+    size_t count = 0;
+    if (fread(header, 1, kHeaderSize, file) == kHeaderSize && get_le32(header) == kMagic) {
+        history->clock = get_le32(header + 4);
+        count = get_le16(header + 8);
+    }
+    for (size_t i = 0; i < count && history->count < kUrlHistoryMaxEntries; i++) {
+        uint8_t entry_header[kEntryHeaderSize];
+        char text[kMaxUrlLen + kMaxTitleLen + 2];
+        if (fread(entry_header, 1, kEntryHeaderSize, file) != kEntryHeaderSize) break;
+        size_t url_len = entry_header[1];
+        size_t title_len = entry_header[2];
+        if (url_len == 0 || title_len > kMaxTitleLen || fread(text, 1, url_len + title_len, file) != url_len + title_len) {
+            break;
+        }
+        memmove(text + url_len + 1, text + url_len, title_len);
+        text[url_len] = '\0';
+        text[url_len + 1 + title_len] = '\0';
+
+        // Written in key order, so this only appends, unless the file was
+        // tampered with
+        Entry* entry = Upsert(history, text, text + url_len + 1);
+        if (!entry) break;
+        entry->flags = entry_header[0] & kBookmarked;
+        entry->score = get_le32(entry_header + 4);
+        entry->last = get_le32(entry_header + 8);
+    }
+    fclose(file);
+    return true;
+}
+
+UrlHistory* url_history_open(const char* path) {
+    auto* history = (UrlHistory*)calloc(1, sizeof(UrlHistory));
+    if (!history) return nullptr;
+    history->arena = (char*)malloc(kArenaSize);
+    if (!history->arena || strlen(path) >= sizeof(history->path)) {
+        url_history_close(history);
+        return nullptr;
+    }
+    strcpy(history->path, path);
+    Load(history);
+    return history;
+}
+
+void url_history_close(UrlHistory* history) {
+    if (!history) return;
+    free(history->arena);
+    free(history);
+}
+
+bool url_history_save(UrlHistory* history) {
+    if (!history->dirty) return true;
+
+    // Same name with a .tmp extension, which keeps 8.3 names valid on FAT
+    char temp[sizeof(history->path) + 4];
+    strcpy(temp, history->path);
+    char* dot = strrchr(temp, '.');
+    if (!dot || strchr(dot, '/')) dot = temp + strlen(temp);
+    strcpy(dot, ".tmp");
+    FILE* file = fopen(temp, "wb");
+    if (!file) return false;
+
+    uint8_t header[kHeaderSize] = {};
+    put_le32(header, kMagic);
+    put_le32(header + 4, history->clock);
+    put_le16(header + 8, (uint32_t)history->count);
+    bool ok = fwrite(header, 1, kHeaderSize, file) == kHeaderSize;
+    for (size_t i = 0; ok && i < history->count; i++) {
+        const Entry* entry = &history->entries[i];
+        uint8_t entry_header[kEntryHeaderSize] = {};
+        entry_header[0] = entry->flags;
+        entry_header[1] = entry->url_len;
+        entry_header[2] = entry->title_len;
+        put_le32(entry_header + 4, entry->score);
+        put_le32(entry_header + 8, entry->last);
+        ok = fwrite(entry_header, 1, kEntryHeaderSize, file) == kEntryHeaderSize &&
+             fwrite(Url(history, entry), 1, entry->url_len, file) == entry->url_len &&
+             fwrite(Title(history, entry), 1, entry->title_len, file) == entry->title_len;
+    }
+    ok = ok && fflush(file) == 0;
+    if (ok) fsync(fileno(file));
+    fclose(file);
+
+    // FAT won't rename over an existing file
+    if (ok && rename(temp, history->path) != 0) {
+        remove(history->path);
+        ok = rename(temp, history->path) == 0;
+    }
+    if (!ok) {
+        remove(temp);
+        return false;
+    }
+    history->dirty = false;
+    return true;
+}
+
+void url_history_visit(UrlHistory* history, const char* url, const char* title) {
+    Entry* entry = Upsert(history, url, title);
+    if (!entry) return;
+    uint32_t score = Frecency(history, entry) & (kBookmarkBonus - 1);
+    history->clock++;
+    entry->score = score + kVisitScore < kBookmarkBonus ? score + kVisitScore : kBookmarkBonus - 1;
+    entry->last = history->clock;
+    history->dirty = true;
+}
+
+bool url_history_set_bookmark(UrlHistory* history, const char* url, const char* title, bool bookmarked) {
+    Entry* entry = Upsert(history, url, title);
+    if (!entry) return false;
+    entry->flags = (uint8_t)(bookmarked ? entry->flags | kBookmarked : entry->flags & ~kBookmarked);
+    history->dirty = true;
+    return true;
+}
+
+bool url_history_is_bookmarked(const UrlHistory* history, const char* url) {
+    const Entry* entry = Find(history, url);
+    return entry && (entry->flags & kBookmarked);
+}
+
+// Inserts entry into items by frecency, best first, keeping the max_items best
+static size_t Rank(const UrlHistory* history, const Entry* entry, UrlHistoryItem* items, uint32_t* scores,
+                   size_t count, size_t max_items) {
+    uint32_t score = Frecency(history, entry);
+    size_t at = count;
+    while (at > 0 && scores[at - 1] < score) at--;
+    if (at >= max_items) return count;
+    size_t moved = count < max_items ? count : max_items - 1;
+    memmove(items + at + 1, items + at, (moved - at) * sizeof(UrlHistoryItem));
+    memmove(scores + at + 1, scores + at, (moved - at) * sizeof(uint32_t));
+    items[at] = {Url(history, entry), Title(history, entry), (entry->flags & kBookmarked) != 0};
+    scores[at] = score;
+    return count < max_items ? count + 1 : count;
+}
+
+size_t url_history_suggest(const UrlHistory* history, const char* typed, UrlHistoryItem* items, size_t max_items) {
+    const char* prefix = typed + KeySkip(typed);
+    size_t prefix_len = strlen(prefix);
+    if (prefix_len == 0 || max_items == 0) return 0;
+
+    auto* scores = (uint32_t*)malloc(max_items * sizeof(uint32_t));
+    if (!scores) return 0;
+    size_t count = 0;
+    for (size_t i = LowerBound(history, prefix); i < history->count; i++) {
+        const Entry* entry = &history->entries[i];
+        if (CompareKeys(Key(history, entry), prefix, prefix_len) != 0) break;
+        count = Rank(history, entry, items, scores, count, max_items);
+    }
+    free(scores);
+    return count;
+}
+
+size_t url_history_bookmarks(const UrlHistory* history, UrlHistoryItem* items, size_t max_items) {
+    if (max_items == 0) return 0;
+    auto* scores = (uint32_t*)malloc(max_items * sizeof(uint32_t));
+    if (!scores) return 0;
+    size_t count = 0;
+    for (size_t i = 0; i < history->count; i++) {
+        if (history->entries[i].flags & kBookmarked) {
+            count = Rank(history, &history->entries[i], items, scores, count, max_items);
+        }
+    }
+    free(scores);
+    return count;
+}
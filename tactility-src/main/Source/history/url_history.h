@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Visited URLs and bookmarks, for suggesting URLs as they're typed. Entries
+// are kept sorted by URL without its scheme and "www.", with the URLs and
+// titles in one string arena, so the ones starting with what's typed are a
+// binary search away and form one contiguous range. The scheme and host
+// match in any case, the rest of the URL only as it is.
+//
+// Each entry has a frecency score: a visit adds to it, and it halves every
+// kUrlHistoryHalfLife visits to other pages. Bookmarks rank above history
+// and are never dropped; past kUrlHistoryMaxEntries, or when the arena is
+// full, the history entry with the lowest score makes room.
+//
+// Lives in RAM and is saved to one file, written anew and renamed over the
+// old one. Not thread safe, the app only uses it with the LVGL lock held.
+struct UrlHistory;
+
+constexpr size_t kUrlHistoryMaxEntries = 128;
+constexpr uint32_t kUrlHistoryHalfLife = 32;
+
+struct UrlHistoryItem {
+    const char* url;
+    const char* title;      // "" if none
+    bool bookmarked;
+};
+
+// Loads the history from path; a missing or damaged file starts it empty.
+// nullptr only when out of memory.
+UrlHistory* url_history_open(const char* path);
+void url_history_close(UrlHistory* history);
+
+// Writes the history out if it changed since it was loaded or last saved
+bool url_history_save(UrlHistory* history);
+
+void url_history_visit(UrlHistory* history, const char* url, const char* title);
+
+// Adds or removes a bookmark; the URL stays in the history either way
+bool url_history_set_bookmark(UrlHistory* history, const char* url, const char* title, bool bookmarked);
+bool url_history_is_bookmarked(const UrlHistory* history, const char* url);
+
+// Stores the entries whose URL starts with typed (scheme and "www." aside),
+// best first, and returns their count. The items point into the history
+// and are valid until it next changes.
+size_t url_history_suggest(const UrlHistory* history, const char* typed, UrlHistoryItem* items, size_t max_items);
+
+// Stores the bookmarks, best first, and returns their count
+size_t url_history_bookmarks(const UrlHistory* history, UrlHistoryItem* items, size_t max_items);
@@ -1,7 +1,9 @@
 #include "html2text.h"
+#include "html_tags.h"
 #include <cstring>
-#include <cctype>
 #include <cstdlib>
+#include <cstdio>
+#include <cstdint>
 
 // Local implementation of strncmp since it's not exported for now
 static int local_strncmp(const char* s1, const char* s2, size_t n) {
@@ -16,112 +18,1750 @@ static int local_strncmp(const char* s1, const char* s2, size_t n) {
     return 0;
 }
 
-enum { HTML_FIRST, HTML_MID };
-
-static int SearchHtmlTag(const char* html, int offset, int* condition) {
-    int i = offset;
-    size_t max = strlen(html);
-
-    if (offset >= (int)max) return -2;
-
-    switch (*condition) {
-        case HTML_FIRST:
-            while (i <= (int)max) {
-                if (local_strncmp(html + i, "<", 1) == 0) {
-                    while (1) {
-                        i++;
-                        if (local_strncmp(html + i, ">", 1) == 0) {
-                            i++;
-                            if (local_strncmp(html + i, "<", 1) == 0) {
-                                return SearchHtmlTag(html, i, condition);
-                            } else {
-                                return i;
-                            }
-                        }
-                        if (i == (int)max) {
-                            *condition = HTML_MID;
-                            return -1;
-                        }
-                    }
+// Tokenizer states. Quotes only matter right after '=' inside a tag, so
+// '>' in an attribute value no longer ends the tag, while comments and
+// declarations are scanned without any quote tracking.
+enum HtmlState {
+    HTML_TEXT,
+    HTML_ENTITY,            // saw '&'
+    HTML_TAG_OPEN,          // saw '<'
+    HTML_TAG_NAME,
+    HTML_TAG_ATTRS,         // between attributes, '>' ends the tag
+    HTML_TAG_BEFORE_VALUE,  // after '=', a quote here opens a value
+    HTML_TAG_VALUE_DQ,
+    HTML_TAG_VALUE_SQ,
+    HTML_MARKUP_OPEN,       // saw "<!"
+    HTML_COMMENT_OPEN,      // saw "<!-"
+    HTML_COMMENT,
+    HTML_DECL,              // <!DOCTYPE ...>, <?xml ...?>, bogus tags
+    HTML_RAWTEXT,           // <script>/<style> body
+    HTML_RAWTEXT_LT,        // saw '<' in raw text
+    HTML_RAWTEXT_END,       // matching "</name" in raw text
+};
+
+constexpr size_t kTagNameMax = 12;
+constexpr size_t kAttrBufSize = 384;
+constexpr size_t kEntityMax = 10;
+constexpr int kMaxLinks = 64;
+constexpr size_t kLinkPoolSize = 2048;
+constexpr size_t kBaseHrefMax = 160;
+constexpr int kTableMaxRows = 16;
+constexpr int kTableMaxCols = 8;
+constexpr size_t kTablePoolSize = 1536;
+constexpr size_t kTableLineWidth = 40;
+constexpr size_t kTitleMax = 96;
+constexpr size_t kSliceStep = 512;  // bytes converted between clock checks
+#if HTML2TEXT_PARALLEL
+constexpr size_t kParallelMin = 16384;
+#endif
+
+// Known tags that don't belong in <head>
+static bool IsBodyTag(HtmlTagId id) {
+    switch (id) {
+        case TAG_UNKNOWN:
+        case TAG_BASE:
+        case TAG_HEAD:
+        case TAG_HTML:
+        case TAG_LINK:
+        case TAG_META:
+        case TAG_NOSCRIPT:
+        case TAG_SCRIPT:
+        case TAG_STYLE:
+        case TAG_TEMPLATE:
+        case TAG_TITLE:
+            return false;
+        default:
+            return true;
+    }
+}
+
+static bool NameIs(const char* name, size_t len, const char* literal) {
+    size_t literal_len = strlen(literal);
+    return len == literal_len && local_strncmp(name, literal, len) == 0;
+}
+
+static bool IsAttrSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+// ASCII stand-ins for <cctype>, which goes through the locale table on
+// every byte; markup is ASCII, so these compile to a compare or two
+static bool IsAsciiDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static bool IsAsciiAlpha(char c) {
+    return (unsigned char)((c | 0x20) - 'a') < 26;
+}
+
+static bool IsAsciiAlnum(char c) {
+    return IsAsciiAlpha(c) || IsAsciiDigit(c);
+}
+
+static char AsciiLower(char c) {
+    return c >= 'A' && c <= 'Z' ? (char)(c | 0x20) : c;
+}
+
+// Text byte classes, so the converter decides what to do with a byte with
+// one table load instead of a chain of comparisons.
+enum : unsigned char {
+    CC_TEXT = 0,
+    CC_SPACE,       // ' ', '\t', '\f': collapsible
+    CC_NEWLINE,     // '\n': collapsible, kept verbatim in <pre>
+    CC_CR,          // '\r': dropped so CRLF becomes LF in <pre>
+    CC_NBSP_LEAD,   // 0xC2, first byte of U+00A0 in UTF-8
+    CC_MARKUP,      // '<' and '&'
+};
+
+struct CharClassTable {
+    unsigned char cls[256];
+};
+
+static constexpr CharClassTable MakeCharClassTable() {
+    CharClassTable table = {};
+    table.cls[(unsigned char)' '] = CC_SPACE;
+    table.cls[(unsigned char)'\t'] = CC_SPACE;
+    table.cls[(unsigned char)'\f'] = CC_SPACE;
+    table.cls[(unsigned char)'\v'] = CC_SPACE;
+    table.cls[(unsigned char)'\n'] = CC_NEWLINE;
+    table.cls[(unsigned char)'\r'] = CC_CR;
+    table.cls[0xC2] = CC_NBSP_LEAD;
+    table.cls[(unsigned char)'<'] = CC_MARKUP;
+    table.cls[(unsigned char)'&'] = CC_MARKUP;
+    return table;
+}
+
+static constexpr CharClassTable kCharClass = MakeCharClassTable();
+
+// Entities we decode. The stock LVGL fonts only carry ASCII, so
+// typographic characters map to ASCII stand-ins; anything else numeric is
+// written out as UTF-8.
+struct HtmlEntity {
+    const char* name;
+    unsigned codepoint;
+    const char* ascii;
+};
+
+static const HtmlEntity kEntities[] = {
+    {"amp", 38, "&"},
+    {"lt", 60, "<"},
+    {"gt", 62, ">"},
+    {"quot", 34, "\""},
+    {"apos", 39, "'"},
+    {"nbsp", 160, " "},
+    {"copy", 169, "(c)"},
+    {"reg", 174, "(R)"},
+    {"laquo", 171, "<<"},
+    {"raquo", 187, ">>"},
+    {"middot", 183, "."},
+    {"times", 215, "x"},
+    {"ndash", 8211, "-"},
+    {"mdash", 8212, "--"},
+    {"lsquo", 8216, "'"},
+    {"rsquo", 8217, "'"},
+    {"ldquo", 8220, "\""},
+    {"rdquo", 8221, "\""},
+    {"bull", 8226, "*"},
+    {"hellip", 8230, "..."},
+    {"euro", 8364, "EUR"},
+    {"trade", 8482, "(TM)"},
+};
+
+// Finds attribute `name` in the raw attribute text of a tag (everything
+// after the tag name). Only called for the handful of elements whose
+// attributes we use, so ordinary tags never pay for this scan.
+static const char* FindHtmlAttr(const char* attrs, size_t len, const char* name, size_t* value_len) {
+    size_t name_len = strlen(name);
+    size_t i = 0;
+    while (i < len) {
+        while (i < len && (IsAttrSpace(attrs[i]) || attrs[i] == '/')) i++;
+        size_t key_start = i;
+        while (i < len && !IsAttrSpace(attrs[i]) && attrs[i] != '=' && attrs[i] != '/') i++;
+        size_t key_len = i - key_start;
+        while (i < len && IsAttrSpace(attrs[i])) i++;
+
+        const char* value = attrs + i;
+        size_t vlen = 0;
+        if (i < len && attrs[i] == '=') {
+            i++;
+            while (i < len && IsAttrSpace(attrs[i])) i++;
+            if (i < len && (attrs[i] == '"' || attrs[i] == '\'')) {
+                char quote = attrs[i++];
+                value = attrs + i;
+                while (i < len && attrs[i] != quote) i++;
+                vlen = (size_t)(attrs + i - value);
+                if (i < len) i++;
+            } else {
+                value = attrs + i;
+                while (i < len && !IsAttrSpace(attrs[i])) i++;
+                vlen = (size_t)(attrs + i - value);
+            }
+        }
+
+        if (key_len == name_len) {
+            bool match = true;
+            for (size_t k = 0; k < name_len; k++) {
+                if (AsciiLower(attrs[key_start + k]) != name[k]) {
+                    match = false;
+                    break;
+                }
+            }
+            if (match) {
+                *value_len = vlen;
+                return value;
+            }
+        }
+        if (key_len == 0 && i < len) i++;
+    }
+    return nullptr;
+}
+
+static bool StartsWithNoCase(const char* s, size_t len, const char* prefix) {
+    size_t prefix_len = strlen(prefix);
+    if (len < prefix_len) return false;
+    for (size_t i = 0; i < prefix_len; i++) {
+        if (AsciiLower(s[i]) != prefix[i]) return false;
+    }
+    return true;
+}
+
+// The codepoint of the entity named after '&' (without the ';'), 0 if it
+// isn't one we decode. Like browsers we only take terminated ones.
+static unsigned EntityCodepoint(const char* name, size_t len, bool terminated) {
+    if (!terminated) return 0;
+    if (len > 1 && name[0] == '#') {
+        unsigned codepoint = 0;
+        bool hex = name[1] == 'x' || name[1] == 'X';
+        size_t i = hex ? 2 : 1;
+        bool valid = i < len;
+        for (; i < len && valid && codepoint <= 0x10FFFF; i++) {
+            char d = name[i];
+            if (IsAsciiDigit(d)) {
+                codepoint = codepoint * (hex ? 16u : 10u) + (unsigned)(d - '0');
+            } else if (hex && AsciiLower(d) >= 'a' && AsciiLower(d) <= 'f') {
+                codepoint = codepoint * 16u + (unsigned)(AsciiLower(d) - 'a' + 10);
+            } else {
+                valid = false;
+            }
+        }
+        return valid && codepoint <= 0x10FFFF ? codepoint : 0;
+    }
+    for (const HtmlEntity& known : kEntities) {
+        if (NameIs(name, len, known.name)) return known.codepoint;
+    }
+    return 0;
+}
+
+// The ASCII stand-in for a codepoint, nullptr if it has none
+static const char* EntityAscii(unsigned codepoint) {
+    for (const HtmlEntity& known : kEntities) {
+        if (known.codepoint == codepoint) return known.ascii;
+    }
+    return nullptr;
+}
+
+// Writes a codepoint as 1-4 bytes of UTF-8 and returns how many
+static size_t PutUtf8(unsigned codepoint, char* out) {
+    if (codepoint < 0x80) {
+        out[0] = (char)codepoint;
+        return 1;
+    } else if (codepoint < 0x800) {
+        out[0] = (char)(0xC0 | (codepoint >> 6));
+        out[1] = (char)(0x80 | (codepoint & 0x3F));
+        return 2;
+    } else if (codepoint < 0x10000) {
+        out[0] = (char)(0xE0 | (codepoint >> 12));
+        out[1] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (codepoint & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (codepoint >> 18));
+    out[1] = (char)(0x80 | ((codepoint >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (codepoint & 0x3F));
+    return 4;
+}
+
+// Decodes the entities in an attribute value in place and returns its new
+// length; a reference never decodes to more bytes than it takes. URLs get
+// the real characters, text gets the same ASCII stand-ins as page text.
+static size_t DecodeAttrValue(char* value, size_t len, bool text) {
+    size_t out = 0;
+    for (size_t i = 0; i < len;) {
+        if (value[i] != '&') {
+            value[out++] = value[i++];
+            continue;
+        }
+        size_t name_len = 0;
+        while (i + 1 + name_len < len && name_len < kEntityMax &&
+               (IsAsciiAlnum(value[i + 1 + name_len]) || (value[i + 1 + name_len] == '#' && name_len == 0))) {
+            name_len++;
+        }
+        bool terminated = i + 1 + name_len < len && value[i + 1 + name_len] == ';';
+        unsigned codepoint = EntityCodepoint(value + i + 1, name_len, terminated);
+        const char* ascii = text && codepoint != 0 ? EntityAscii(codepoint) : nullptr;
+        if (codepoint == 0 || (ascii && strlen(ascii) > name_len + 2)) {
+            // Unknown, or a stand-in longer than the reference: keep the '&'
+            value[out++] = value[i++];
+        } else if (ascii) {
+            size_t n = strlen(ascii);
+            memmove(value + out, ascii, n);
+            out += n;
+            i += name_len + 2;
+        } else {
+            out += PutUtf8(codepoint, value + out);
+            i += name_len + 2;
+        }
+    }
+    return out;
+}
+
+struct TableCell {
+    uint16_t offset;
+    uint16_t length;
+    uint16_t width;     // in characters, not bytes
+};
+
+// Rows of the outermost table are buffered here until the table ends or
+// the buffer fills, then laid out as a batch. Nested tables are flattened
+// into the enclosing cell.
+struct HtmlTable {
+    int depth;
+    bool cell_open;
+    bool direct;        // current row didn't fit, it is written as "a | b"
+    bool first_batch;
+    int rows;           // completed rows in the buffer
+    int cols;           // cells so far in the row being built
+    uint8_t row_cols[kTableMaxRows];
+    TableCell cells[kTableMaxRows + 1][kTableMaxCols];
+    char pool[kTablePoolSize];
+    size_t pool_len;
+};
+
+enum { TITLE_NONE, TITLE_OPEN, TITLE_DONE };
+
+#if HTML2TEXT_PARALLEL
+// Kept by the speculative second half of a parallel conversion: what it
+// needs to be stitched onto the first half once that is done.
+struct SplitLog {
+    bool lead_seen;         // the first text has been written
+    bool lead_space;        // pending whitespace in front of it
+    int lead_breaks;
+    bool diverged;          // output depends on the first half, can't stitch
+    bool markers_lost;      // a link marker went into a table cell or title
+    bool links_off;         // guessed that the first half fills the link table
+    size_t min_link_size;   // smallest link dropped because of that, 0 if none
+    int marker_count;
+    uint32_t marker_pos[kMaxLinks];
+    uint8_t marker_link[kMaxLinks];
+};
+#endif
+
+// Output sinks. The converter is a template over its sink, so the measuring
+// and the writing pass each compile to a loop with the sink calls inlined.
+
+// Writes into a fixed buffer, dropping whatever doesn't fit
+struct BufferSink {
+    char* data;
+    size_t len;
+    size_t cap;     // not counting the NUL terminator
+    bool truncated;
+
+    void Put(const char* s, size_t n) {
+        if (n > cap - len) {
+            n = cap - len;
+            truncated = true;
+        }
+        memcpy(data + len, s, n);
+        len += n;
+    }
+    char Back(size_t i) const { return i < len ? data[len - 1 - i] : '\0'; }
+    void TrimSpaces() {
+        while (len > 0 && data[len - 1] == ' ') len--;
+    }
+    void TrimWhitespace() {
+        while (len > 0 && (data[len - 1] == ' ' || data[len - 1] == '\n')) len--;
+    }
+    void Terminate() { data[len] = '\0'; }
+};
+
+// Only counts, for sizing an allocation exactly. It remembers just enough
+// of the tail (two bytes, and the trailing whitespace runs) to make the
+// same whitespace decisions as BufferSink.
+struct CountingSink {
+    size_t len;
+    char tail[2];           // tail[0] is the last byte
+    size_t spaces;          // trailing run of ' '
+    char before_spaces[2];  // tail as it was before that run
+    size_t blanks;          // trailing run of ' ' and '\n'
+    bool truncated;         // never set, the count is unbounded
+
+    void Put(const char* s, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            char c = s[i];
+            if (c == ' ') {
+                if (spaces++ == 0) {
+                    before_spaces[0] = tail[0];
+                    before_spaces[1] = tail[1];
+                }
+            } else {
+                spaces = 0;
+            }
+            blanks = (c == ' ' || c == '\n') ? blanks + 1 : 0;
+            tail[1] = tail[0];
+            tail[0] = c;
+        }
+        len += n;
+    }
+    char Back(size_t i) const { return i < len && i < 2 ? tail[i] : '\0'; }
+    void TrimSpaces() {
+        if (spaces == 0) return;
+        len -= spaces;
+        blanks -= spaces;
+        spaces = 0;
+        tail[0] = before_spaces[0];
+        tail[1] = before_spaces[1];
+    }
+    void TrimWhitespace() {
+        len -= blanks;
+        blanks = 0;
+        spaces = 0;
+        tail[0] = tail[1] = '\0';
+    }
+};
+
+template <typename Sink>
+struct Html2TextConverter {
+    Sink sink;
+
+    HtmlState state;
+    char tag_name[kTagNameMax];
+    size_t tag_name_len;
+    HtmlTagId tag_id;
+    bool tag_is_end;
+    bool tag_self_closing;  // a '/' right before the '>'
+    bool capture_attrs;
+    char attr_buf[kAttrBufSize];
+    size_t attr_len;
+    int comment_dashes;
+
+    char raw_name[kTagNameMax];
+    size_t raw_name_len;
+    HtmlTagId raw_id;
+    size_t raw_match;
+
+    bool pending_space;
+    int pending_breaks;
+    int pre_depth;
+    bool pre_fresh;
+    bool nbsp_lead;
+    char entity[kEntityMax];
+    size_t entity_len;
+
+    char base_href[kBaseHrefMax];
+    int open_link;
+    int link_count;
+    size_t link_offsets[kMaxLinks];
+    char link_pool[kLinkPoolSize];
+    size_t link_pool_len;
+
+    HtmlTable table;
+
+    // Optional side table of styled runs, off unless spans were requested
+    Html2TextSpan* spans;
+    size_t span_count;
+    size_t span_cap;
+    int bold_depth;
+    int italic_depth;
+    int code_depth;
+    int heading;
+
+    // Optional outline, one entry per heading that produced text
+    Html2TextHeading* headings;
+    size_t heading_count;
+    size_t heading_cap;
+    bool heading_fresh;     // inside a heading whose text hasn't started yet
+
+    // The first <title> is kept out of the text and reported separately
+    int title_state;
+    char title[kTitleMax];
+    size_t title_len;
+
+#if HTML2TEXT_PARALLEL
+    SplitLog* split;
+#endif
+
+    void Feed(const char* html, size_t len);
+    void Finish();
+
+    template <typename Out>
+    void WriteReferences(Out& out) const;
+
+private:
+    void Emit(const char* s, size_t len);
+    void Space();
+    void Break(int lines);
+    void Text(char c);
+    void AddText(const char* s, size_t len);
+    void FlushEntity(bool terminated);
+    void TitlePut(const char* s, size_t len);
+    void EndTitle();
+    void StartTag(char c);
+    void EndTagName();
+    void OnTag();
+    int AddLink(const char* href, size_t len);
+    size_t DecodeAttr(const char* value, size_t len, bool text);
+
+    void StyleTag();
+    void RecordSpan(size_t start, size_t end);
+    void RecordHeading(size_t start);
+#if HTML2TEXT_PARALLEL
+    void SplitLead();
+    void SplitMarker(size_t len, bool to_sink);
+#endif
+
+    bool TableTag();
+    void CellStart();
+    void CellClose();
+    void CellPut(const char* s, size_t len);
+    void RowEnd();
+    void GoDirect();
+    void FlushTable();
+};
+
+// Writes visible text, first settling any whitespace or line breaks that
+// were collapsed in front of it.
+template <typename Sink>
+void Html2TextConverter<Sink>::Emit(const char* s, size_t len) {
+    if (title_state == TITLE_OPEN) {
+        TitlePut(s, len);
+        return;
+    }
+    if (table.cell_open && !table.direct) {
+        CellPut(s, len);
+        return;
+    }
+    if (table.rows > 0) {
+        // Stray text between cells: keep it after the rows seen so far
+        FlushTable();
+    }
+
+    if (sink.len > 0) {
+        if (pending_breaks > 0) {
+            sink.TrimSpaces();
+            int have = 0;
+            while (have < pending_breaks && sink.Back((size_t)have) == '\n') have++;
+            for (; have < pending_breaks; have++) sink.Put("\n", 1);
+        } else if (pending_space && sink.Back(0) != ' ' && sink.Back(0) != '\n') {
+            sink.Put(" ", 1);
+        }
+    }
+#if HTML2TEXT_PARALLEL
+    if (sink.len == 0 && split) SplitLead();
+#endif
+    pending_space = false;
+    pending_breaks = 0;
+    size_t start = sink.len;
+    sink.Put(s, len);
+    if (spans) RecordSpan(start, sink.len);
+    if (heading_fresh) RecordHeading(start);
+}
+
+// A title that fills up is taken to be unclosed, and what follows is the
+// page's text
+template <typename Sink>
+void Html2TextConverter<Sink>::TitlePut(const char* s, size_t len) {
+    bool separate = (pending_space || pending_breaks > 0) && title_len > 0;
+    pending_space = false;
+    pending_breaks = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (s[i] == ' ' || s[i] == '\n') {
+            separate = title_len > 0;
+            continue;
+        }
+        if (title_len + (separate ? 2 : 1) > kTitleMax - 1) {
+            EndTitle();
+            Emit(s + i, len - i);
+            return;
+        }
+        if (separate) title[title_len++] = ' ';
+        separate = false;
+        title[title_len++] = s[i];
+    }
+    pending_space = separate;
+}
+
+template <typename Sink>
+void Html2TextConverter<Sink>::EndTitle() {
+    title[title_len] = '\0';
+    title_state = TITLE_DONE;
+    pending_space = false;
+    pending_breaks = 0;
+}
+
+template <typename Sink>
+void Html2TextConverter<Sink>::Space() {
+    if (pre_depth > 0) {
+        Emit(" ", 1);
+    } else {
+        pending_space = true;
+    }
+}
+
+template <typename Sink>
+void Html2TextConverter<Sink>::Break(int lines) {
+    if (lines > pending_breaks) pending_breaks = lines;
+    pending_space = false;
+}
+
+// One byte of character data. Runs of HTML whitespace collapse into a
+// single space, except inside <pre> where they are copied verbatim.
+template <typename Sink>
+void Html2TextConverter<Sink>::Text(char c) {
+    // A newline straight after <pre> is not part of its content
+    bool fresh = pre_fresh;
+    if (c != '\r') pre_fresh = false;
+
+    if (nbsp_lead) {
+        nbsp_lead = false;
+        if ((unsigned char)c == 0xA0) {
+            Space();
+            return;
+        }
+        Emit("\xC2", 1);
+    }
+
+    switch (kCharClass.cls[(unsigned char)c]) {
+        case CC_SPACE:
+            if (pre_depth > 0) {
+                Emit(&c, 1);
+            } else {
+                pending_space = true;
+            }
+            break;
+        case CC_NEWLINE:
+            if (pre_depth > 0) {
+                if (!fresh) Emit("\n", 1);
+            } else {
+                pending_space = true;
+            }
+            break;
+        case CC_CR:
+            if (pre_depth == 0) pending_space = true;
+            break;
+        case CC_NBSP_LEAD:
+            nbsp_lead = true;
+            break;
+        default:
+            Emit(&c, 1);
+            break;
+    }
+}
+
+template <typename Sink>
+void Html2TextConverter<Sink>::AddText(const char* s, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        Text(s[i]);
+    }
+}
+
+// Decodes the entity collected after '&'. Unknown or malformed entities
+// are passed through as they appeared in the source.
+template <typename Sink>
+void Html2TextConverter<Sink>::FlushEntity(bool terminated) {
+    const char* name = entity;
+    size_t len = entity_len;
+    entity_len = 0;
+
+    unsigned codepoint = EntityCodepoint(name, len, terminated);
+    if (codepoint == 160) {
+        Space();
+        return;
+    } else if (codepoint != 0) {
+        const char* ascii = EntityAscii(codepoint);
+        if (ascii) {
+            Emit(ascii, strlen(ascii));
+        } else if (codepoint < 0x80) {
+            char c = (char)codepoint;
+            AddText(&c, 1);
+        } else {
+            char utf8[4];
+            Emit(utf8, PutUtf8(codepoint, utf8));
+        }
+        return;
+    }
+
+    Emit("&", 1);
+    Emit(name, len);
+    if (terminated) Emit(";", 1);
+}
+
+// Appends text to the open cell. Line breaks inside a cell become spaces so
+// each cell stays on one line of the laid-out row.
+template <typename Sink>
+void Html2TextConverter<Sink>::CellPut(const char* s, size_t len) {
+    TableCell& cell = table.cells[table.rows][table.cols - 1];
+    bool separate = pending_space || pending_breaks > 0;
+    pending_space = false;
+    pending_breaks = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        char c = s[i];
+        if (c == '\n' || c == ' ') {
+            separate = true;
+            continue;
+        }
+        bool space = separate && table.pool_len > cell.offset && table.pool[table.pool_len - 1] != ' ';
+        if (table.pool_len + (space ? 2 : 1) > kTablePoolSize) {
+            // Out of buffer space: write what we have and finish this row
+            // unbuffered, so a huge table never needs more memory.
+            GoDirect();
+            pending_space = separate;
+            Emit(s + i, len - i);
+            return;
+        }
+        if (space) table.pool[table.pool_len++] = ' ';
+        separate = false;
+        table.pool[table.pool_len++] = c;
+    }
+    if (separate) pending_space = true;
+}
+
+template <typename Sink>
+void Html2TextConverter<Sink>::CellStart() {
+    CellClose();
+    if (!table.direct && table.cols == kTableMaxCols) GoDirect();
+
+    if (table.direct) {
+        if (table.cols > 0) {
+            Emit(" | ", 3);
+        }
+        pending_space = false;
+        pending_breaks = 0;
+    } else {
+        TableCell& cell = table.cells[table.rows][table.cols];
+        cell.offset = (uint16_t)table.pool_len;
+        cell.length = 0;
+        cell.width = 0;
+    }
+    table.cols++;
+    table.cell_open = true;
+}
+
+template <typename Sink>
+void Html2TextConverter<Sink>::CellClose() {
+    if (!table.cell_open) return;
+    table.cell_open = false;
+    pending_space = false;
+    pending_breaks = 0;
+    if (table.direct) return;
+
+    TableCell& cell = table.cells[table.rows][table.cols - 1];
+    size_t end = table.pool_len;
+    while (end > cell.offset && table.pool[end - 1] == ' ') end--;
+    table.pool_len = end;
+    cell.length = (uint16_t)(end - cell.offset);
+    uint16_t width = 0;
+    for (size_t i = cell.offset; i < end; i++) {
+        if (((unsigned char)table.pool[i] & 0xC0) != 0x80) width++;
+    }
+    cell.width = width;
+}
+
+template <typename Sink>
+void Html2TextConverter<Sink>::RowEnd() {
+    CellClose();
+    if (table.direct) {
+        table.direct = false;
+        Break(1);
+    } else if (table.cols > 0) {
+        table.row_cols[table.rows++] = (uint8_t)table.cols;
+        table.cols = 0;
+        if (table.rows == kTableMaxRows) FlushTable();
+    }
+    table.cols = 0;
+}
+
+// Writes the buffered rows, then the partial current row, and switches the
+// rest of that row to unbuffered "cell | cell" output.
+template <typename Sink>
+void Html2TextConverter<Sink>::GoDirect() {
+    int cols = table.cols;
+    bool open = table.cell_open;
+    if (open) {
+        table.cells[table.rows][cols - 1].length =
+            (uint16_t)(table.pool_len - table.cells[table.rows][cols - 1].offset);
+    }
+    table.direct = true;
+    table.cell_open = false;
+
+    FlushTable();
+    Break(table.first_batch ? 2 : 1);
+    table.first_batch = false;
+    for (int c = 0; c < cols; c++) {
+        const TableCell& cell = table.cells[0][c];
+        if (c > 0) Emit(" | ", 3);
+        Emit(table.pool + cell.offset, cell.length);
+    }
+    table.pool_len = 0;
+    table.cell_open = open;
+}
+
+// Lays out the buffered rows: aligned columns when they fit the line
+// width, otherwise one "cell | cell" line per row.
+template <typename Sink>
+void Html2TextConverter<Sink>::FlushTable() {
+    int rows = table.rows;
+    table.rows = 0;
+
+    uint16_t widths[kTableMaxCols] = {};
+    int cols = 0;
+    for (int r = 0; r < rows; r++) {
+        if (table.row_cols[r] > cols) cols = table.row_cols[r];
+        for (int c = 0; c < table.row_cols[r]; c++) {
+            if (table.cells[r][c].width > widths[c]) widths[c] = table.cells[r][c].width;
+        }
+    }
+    size_t total = 0;
+    for (int c = 0; c < cols; c++) total += widths[c] + (c > 0 ? 2u : 0u);
+    bool aligned = total <= kTableLineWidth;
+
+    for (int r = 0; r < rows; r++) {
+        Break(table.first_batch ? 2 : 1);
+        table.first_batch = false;
+        for (int c = 0; c < table.row_cols[r]; c++) {
+            const TableCell& cell = table.cells[r][c];
+            if (c > 0) {
+                if (aligned) {
+                    const TableCell& prev = table.cells[r][c - 1];
+                    for (int pad = widths[c - 1] - prev.width + 2; pad > 0; pad--) sink.Put(" ", 1);
                 } else {
-                    i++;
-                    if (i >= (int)max) return -3;
+                    sink.Put(" | ", 3);
                 }
             }
+            Emit(table.pool + cell.offset, cell.length);
+        }
+    }
+
+    if (rows > 0) {
+        // The row under construction sits after the completed ones; move
+        // it to the front, its pool offsets stay valid until it ends.
+        memcpy(table.cells[0], table.cells[rows], sizeof(table.cells[0]));
+        Break(1);
+    }
+    if (table.cols == 0 || table.direct) table.pool_len = 0;
+}
+
+// Handles table structure tags. Returns false for tags it doesn't own.
+template <typename Sink>
+bool Html2TextConverter<Sink>::TableTag() {
+    bool is_table = tag_id == TAG_TABLE;
+    bool is_row = tag_id == TAG_TR;
+    bool is_cell = tag_id == TAG_TD || tag_id == TAG_TH;
+    if (!is_table && !is_row && !is_cell) return false;
+
+    if (is_table) {
+        if (!tag_is_end) {
+            if (table.depth++ == 0) {
+                Break(2);
+                table.first_batch = true;
+                table.rows = 0;
+                table.cols = 0;
+                table.pool_len = 0;
+                table.direct = false;
+            } else {
+                pending_space = true;
+            }
+        } else if (table.depth == 1) {
+            RowEnd();
+            FlushTable();
+            table.depth = 0;
+            Break(2);
+        } else if (table.depth > 1) {
+            table.depth--;
+            pending_space = true;
+        }
+        return true;
+    }
+
+    if (table.depth != 1) {
+        // Nested or stray rows and cells just separate their text
+        if (is_row && table.depth == 0) {
+            Break(1);
+        } else {
+            pending_space = true;
+        }
+        return true;
+    }
+
+    if (is_row) {
+        RowEnd();
+    } else if (!tag_is_end) {
+        CellStart();
+    } else {
+        CellClose();
+    }
+    return true;
+}
+
+template <typename Sink>
+void Html2TextConverter<Sink>::StyleTag() {
+    int* depth = nullptr;
+    switch (tag_id) {
+        case TAG_H1: case TAG_H2: case TAG_H3: case TAG_H4: case TAG_H5: case TAG_H6:
+            heading = tag_is_end ? 0 : HtmlTagHeadingLevel(tag_id);
+            heading_fresh = headings && heading > 0;
+            return;
+        case TAG_B: case TAG_STRONG:
+            depth = &bold_depth;
+            break;
+        case TAG_I: case TAG_EM: case TAG_CITE: case TAG_VAR: case TAG_DFN:
+            depth = &italic_depth;
+            break;
+        case TAG_CODE: case TAG_TT: case TAG_KBD: case TAG_SAMP: case TAG_PRE:
+            depth = &code_depth;
+            break;
+        default:
+            return;
+    }
+    if (!tag_is_end) {
+        (*depth)++;
+    } else if (*depth > 0) {
+        (*depth)--;
+    }
+}
+
+// Records text written at [start, end) under the current style. Plain text
+// gets no span, and a run continuing the previous span across at most one
+// separator character extends it instead of adding a new entry.
+template <typename Sink>
+void Html2TextConverter<Sink>::RecordSpan(size_t start, size_t end) {
+    if (end <= start) return;
+    uint8_t style = (uint8_t)heading;
+    if (bold_depth > 0) style |= HTML2TEXT_BOLD;
+    if (italic_depth > 0) style |= HTML2TEXT_ITALIC;
+    if (code_depth > 0) style |= HTML2TEXT_CODE;
+    if (open_link >= 0) style |= HTML2TEXT_LINK;
+    if (style == 0) return;
+    uint8_t link = open_link >= 0 ? (uint8_t)open_link : 0;
+
+    if (span_count > 0) {
+        Html2TextSpan& last = spans[span_count - 1];
+        size_t last_end = last.offset + last.length;
+        if (last.style == style && last.link == link && start >= last_end && start - last_end <= 1 &&
+            end - last.offset <= UINT16_MAX) {
+            last.length = (uint16_t)(end - last.offset);
+            return;
+        }
+    }
+    if (span_count == span_cap) return;
+    Html2TextSpan& span = spans[span_count++];
+    span.offset = (uint32_t)start;
+    span.length = (uint16_t)(end - start);
+    span.style = style;
+    span.link = link;
+}
+
+template <typename Sink>
+void Html2TextConverter<Sink>::RecordHeading(size_t start) {
+    heading_fresh = false;
+    if (heading_count == heading_cap || sink.truncated) return;
+    Html2TextHeading& entry = headings[heading_count++];
+    entry.offset = (uint32_t)start;
+    entry.level = (uint8_t)heading;
+}
+
+#if HTML2TEXT_PARALLEL
+// The speculative half starts with nothing written, so the whitespace that
+// joins its first text to the first half is noted for the stitch instead.
+template <typename Sink>
+void Html2TextConverter<Sink>::SplitLead() {
+    if (!split->lead_seen) {
+        split->lead_seen = true;
+        split->lead_space = pending_space;
+        split->lead_breaks = pending_breaks;
+    } else if (pending_space || pending_breaks > 0) {
+        split->diverged = true;
+    }
+}
+
+// Link markers are numbered per half, so their positions are kept for the
+// stitch to renumber them
+template <typename Sink>
+void Html2TextConverter<Sink>::SplitMarker(size_t len, bool to_sink) {
+    if (!to_sink || sink.truncated || split->marker_count == kMaxLinks) {
+        split->markers_lost = true;
+        return;
+    }
+    split->marker_pos[split->marker_count] = (uint32_t)(sink.len - len);
+    split->marker_link[split->marker_count] = (uint8_t)open_link;
+    split->marker_count++;
+}
+#endif
+
+template <typename Sink>
+int Html2TextConverter<Sink>::AddLink(const char* href, size_t len) {
+    while (len > 0 && IsAttrSpace(*href)) { href++; len--; }
+    while (len > 0 && IsAttrSpace(href[len - 1])) len--;
+    if (len == 0 || href[0] == '#' || StartsWithNoCase(href, len, "javascript:")) return -1;
+    if (link_count >= kMaxLinks) return -1;
+
+    // Resolve against <base href> when the link has no scheme of its own
+    const char* prefix = "";
+    size_t prefix_len = 0;
+    bool absolute = false;
+    for (size_t i = 0; i < len && href[i] != '/' && href[i] != '?'; i++) {
+        if (href[i] == ':') {
+            absolute = true;
             break;
-        case HTML_MID:
-            while (1) {
-                if (local_strncmp(html + i, ">", 1) == 0) {
-                    i++;
-                    if (local_strncmp(html + i, "<", 1) == 0) {
-                        return SearchHtmlTag(html, i, condition);
+        }
+    }
+    if (!absolute && base_href[0] != '\0') {
+        prefix = base_href;
+        prefix_len = strlen(base_href);
+        const char* host = strstr(base_href, "://");
+        if (href[0] == '/' && len > 1 && href[1] == '/') {
+            // Protocol-relative: keep only the scheme
+            prefix_len = host ? (size_t)(host - base_href) + 1 : 0;
+        } else if (href[0] == '/') {
+            // Root-relative: keep scheme and host
+            const char* path = host ? strchr(host + 3, '/') : nullptr;
+            if (path) prefix_len = (size_t)(path - base_href);
+        } else {
+            // Document-relative: keep everything up to the last '/'
+            const char* path = host ? strchr(host + 3, '/') : nullptr;
+            if (path) {
+                const char* last_slash = strrchr(path, '/');
+                prefix_len = (size_t)(last_slash - base_href) + 1;
+            } else {
+                // "http://host" has no path, so add the root slash
+                prefix = nullptr;
+            }
+        }
+    }
+
+    size_t needed = prefix_len + (prefix ? 0 : strlen(base_href) + 1) + len + 1;
+#if HTML2TEXT_PARALLEL
+    if (split && split->links_off) {
+        if (split->min_link_size == 0 || needed < split->min_link_size) split->min_link_size = needed;
+        return -1;
+    }
+#endif
+    if (link_pool_len + needed > kLinkPoolSize) return -1;
+
+    char* dst = link_pool + link_pool_len;
+    size_t n = 0;
+    if (prefix) {
+        memcpy(dst, prefix, prefix_len);
+        n = prefix_len;
+    } else {
+        n = strlen(base_href);
+        memcpy(dst, base_href, n);
+        dst[n++] = '/';
+    }
+    memcpy(dst + n, href, len);
+    n += len;
+    dst[n++] = '\0';
+
+    link_offsets[link_count] = link_pool_len;
+    link_pool_len += n;
+    return link_count++;
+}
+
+// Decodes a value FindHtmlAttr() found in attr_buf, where it's writable
+template <typename Sink>
+size_t Html2TextConverter<Sink>::DecodeAttr(const char* value, size_t len, bool text) {
+    return DecodeAttrValue(attr_buf + (value - attr_buf), len, text);
+}
+
+// Called once a tag's closing '>' has been seen. Attributes are only looked
+// at for the elements that captured them.
+template <typename Sink>
+void Html2TextConverter<Sink>::OnTag() {
+    // An unclosed <title> must not swallow the page, so the first tag that
+    // belongs in the body ends it too, and is handled as usual
+    bool is_title = tag_id == TAG_TITLE;
+    if (title_state == TITLE_OPEN && (is_title ? tag_is_end : IsBodyTag(tag_id))) {
+        EndTitle();
+        if (is_title) return;
+    } else if (is_title) {
+        if (!tag_is_end && title_state == TITLE_NONE) title_state = TITLE_OPEN;
+        return;
+    }
+
+    if (TableTag()) return;
+
+    int breaks = HtmlTagBreaks(tag_id);
+    if (breaks > 0) Break(breaks);
+
+    // Inline styles are only tracked when spans or headings are recorded
+    if (spans || headings) StyleTag();
+
+    if (tag_is_end) {
+        if (tag_id == TAG_A && open_link >= 0) {
+            char marker[16];
+            int marker_len = snprintf(marker, sizeof(marker), "[%d]", open_link + 1);
+#if HTML2TEXT_PARALLEL
+            bool to_sink = title_state != TITLE_OPEN && !(table.cell_open && !table.direct);
+            Emit(marker, (size_t)marker_len);
+            if (split) SplitMarker((size_t)marker_len, to_sink);
+#else
+            Emit(marker, (size_t)marker_len);
+#endif
+            open_link = -1;
+        } else if (tag_id == TAG_PRE && pre_depth > 0) {
+            pre_depth--;
+        }
+        return;
+    }
+
+    if (tag_id == TAG_BR) {
+        pending_space = false;
+        if (sink.len > 0) {
+            Emit("\n", 1);
+        }
+#if HTML2TEXT_PARALLEL
+        // Whether a leading break shows depends on the first half
+        if (sink.len == 0 && split) split->diverged = true;
+#endif
+        return;
+    } else if (tag_id == TAG_LI) {
+        Emit("- ", 2);
+        return;
+    } else if (tag_id == TAG_PRE) {
+        pre_depth++;
+        pre_fresh = true;
+        return;
+    }
+
+    HtmlTagClass cls = HtmlTagClassOf(tag_id);
+    // <svg/> has no content to skip; <script/> still has, as in browsers
+    if (cls == HTML_TAG_RAWTEXT || (cls == HTML_TAG_SKIP && !tag_self_closing)) {
+        // Drop everything up to the matching end tag
+        memcpy(raw_name, tag_name, tag_name_len);
+        raw_name_len = tag_name_len;
+        raw_id = tag_id;
+        state = HTML_RAWTEXT;
+        return;
+    }
+
+    if (!capture_attrs) return;
+
+    size_t value_len = 0;
+    const char* value = nullptr;
+    if (tag_id == TAG_A) {
+        value = FindHtmlAttr(attr_buf, attr_len, "href", &value_len);
+        open_link = value ? AddLink(value, DecodeAttr(value, value_len, false)) : -1;
+    } else if (tag_id == TAG_IMG) {
+        value = FindHtmlAttr(attr_buf, attr_len, "alt", &value_len);
+        if (value) AddText(value, DecodeAttr(value, value_len, true));
+    } else if (tag_id == TAG_BASE) {
+        value = FindHtmlAttr(attr_buf, attr_len, "href", &value_len);
+        if (value) value_len = DecodeAttr(value, value_len, false);
+        if (value && value_len < kBaseHrefMax) {
+            memcpy(base_href, value, value_len);
+            base_href[value_len] = '\0';
+        }
+    } else if (tag_id == TAG_META) {
+        // <meta http-equiv="refresh" content="0; url=..."> is how many
+        // sites redirect, so surface the target as a reference.
+        value = FindHtmlAttr(attr_buf, attr_len, "http-equiv", &value_len);
+        if (value && value_len == 7 && StartsWithNoCase(value, value_len, "refresh")) {
+            value = FindHtmlAttr(attr_buf, attr_len, "content", &value_len);
+            if (value) value_len = DecodeAttr(value, value_len, false);
+            for (size_t i = 0; value && i + 4 <= value_len; i++) {
+                if (StartsWithNoCase(value + i, value_len - i, "url=")) {
+                    AddLink(value + i + 4, value_len - i - 4);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+template <typename Sink>
+void Html2TextConverter<Sink>::StartTag(char c) {
+    tag_name[0] = AsciiLower(c);
+    tag_name_len = 1;
+    tag_self_closing = false;
+    capture_attrs = false;
+    attr_len = 0;
+    state = HTML_TAG_NAME;
+}
+
+template <typename Sink>
+void Html2TextConverter<Sink>::EndTagName() {
+    tag_id = HtmlTagLookup(tag_name, tag_name_len);
+    // Lazy attribute capture: only these start tags have attributes we use
+    capture_attrs = !tag_is_end &&
+        (tag_id == TAG_A || tag_id == TAG_IMG || tag_id == TAG_META || tag_id == TAG_BASE);
+    state = HTML_TAG_ATTRS;
+}
+
+template <typename Sink>
+void Html2TextConverter<Sink>::Feed(const char* html, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        char c = html[i];
+        switch (state) {
+            case HTML_TEXT:
+                if (kCharClass.cls[(unsigned char)c] != CC_MARKUP) {
+                    Text(c);
+                    break;
+                }
+                if (nbsp_lead) {
+                    nbsp_lead = false;
+                    Emit("\xC2", 1);
+                }
+                if (c == '<') {
+                    tag_is_end = false;
+                    state = HTML_TAG_OPEN;
+                } else {
+                    entity_len = 0;
+                    state = HTML_ENTITY;
+                }
+                break;
+
+            case HTML_ENTITY:
+                if (c == ';') {
+                    FlushEntity(true);
+                    state = HTML_TEXT;
+                } else if ((IsAsciiAlnum(c) || (c == '#' && entity_len == 0)) && entity_len < kEntityMax) {
+                    entity[entity_len++] = c;
+                } else {
+                    FlushEntity(false);
+                    state = HTML_TEXT;
+                    i--;
+                }
+                break;
+
+            case HTML_TAG_OPEN:
+                if (IsAsciiAlpha(c)) {
+                    StartTag(c);
+                } else if (c == '/' && !tag_is_end) {
+                    tag_is_end = true;
+                } else if (c == '!' && !tag_is_end) {
+                    state = HTML_MARKUP_OPEN;
+                } else if (c == '?' || tag_is_end) {
+                    state = c == '>' ? HTML_TEXT : HTML_DECL;
+                } else {
+                    // A bare '<' is just text
+                    state = HTML_TEXT;
+                    Emit("<", 1);
+                    i--;
+                }
+                break;
+
+            case HTML_TAG_NAME:
+                if (c == '>') {
+                    EndTagName();
+                    state = HTML_TEXT;
+                    OnTag();
+                } else if (IsAttrSpace(c) || c == '/') {
+                    EndTagName();
+                    tag_self_closing = c == '/';
+                } else if (tag_name_len < kTagNameMax) {
+                    tag_name[tag_name_len++] = AsciiLower(c);
+                } else {
+                    // Longer than any tag we handle, keep it unmatched
+                    tag_name_len = kTagNameMax;
+                    tag_name[0] = '\0';
+                }
+                break;
+
+            case HTML_TAG_ATTRS:
+            case HTML_TAG_BEFORE_VALUE:
+            case HTML_TAG_VALUE_DQ:
+            case HTML_TAG_VALUE_SQ:
+                if (state == HTML_TAG_ATTRS && c != '>' && !IsAttrSpace(c)) tag_self_closing = c == '/';
+                if (state == HTML_TAG_VALUE_DQ) {
+                    if (c == '"') state = HTML_TAG_ATTRS;
+                } else if (state == HTML_TAG_VALUE_SQ) {
+                    if (c == '\'') state = HTML_TAG_ATTRS;
+                } else if (c == '>') {
+                    state = HTML_TEXT;
+                    OnTag();
+                    break;
+                } else if (state == HTML_TAG_BEFORE_VALUE) {
+                    if (c == '"') {
+                        state = HTML_TAG_VALUE_DQ;
+                    } else if (c == '\'') {
+                        state = HTML_TAG_VALUE_SQ;
+                    } else if (!IsAttrSpace(c)) {
+                        state = HTML_TAG_ATTRS;
+                    }
+                } else if (c == '=') {
+                    state = HTML_TAG_BEFORE_VALUE;
+                }
+                if (capture_attrs && attr_len < kAttrBufSize) {
+                    attr_buf[attr_len++] = c;
+                }
+                break;
+
+            case HTML_MARKUP_OPEN:
+                state = c == '-' ? HTML_COMMENT_OPEN : (c == '>' ? HTML_TEXT : HTML_DECL);
+                break;
+
+            case HTML_COMMENT_OPEN:
+                if (c == '-') {
+                    comment_dashes = 0;
+                    state = HTML_COMMENT;
+                } else {
+                    state = c == '>' ? HTML_TEXT : HTML_DECL;
+                }
+                break;
+
+            case HTML_COMMENT:
+                if (c == '-') {
+                    comment_dashes++;
+                } else if (c == '>' && comment_dashes >= 2) {
+                    state = HTML_TEXT;
+                } else {
+                    comment_dashes = 0;
+                }
+                break;
+
+            case HTML_DECL:
+                if (c == '>') state = HTML_TEXT;
+                break;
+
+            case HTML_RAWTEXT:
+                if (c == '<') state = HTML_RAWTEXT_LT;
+                break;
+
+            case HTML_RAWTEXT_LT:
+                if (c == '/') {
+                    raw_match = 0;
+                    state = HTML_RAWTEXT_END;
+                } else if (c != '<') {
+                    state = HTML_RAWTEXT;
+                }
+                break;
+
+            case HTML_RAWTEXT_END:
+                if (raw_match < raw_name_len) {
+                    if (AsciiLower(c) == raw_name[raw_match]) {
+                        raw_match++;
                     } else {
-                        return i;
+                        state = c == '<' ? HTML_RAWTEXT_LT : HTML_RAWTEXT;
                     }
+                } else if (c == '>' || IsAttrSpace(c) || c == '/') {
+                    memcpy(tag_name, raw_name, raw_name_len);
+                    tag_name_len = raw_name_len;
+                    tag_id = raw_id;
+                    tag_is_end = true;
+                    capture_attrs = false;
+                    state = c == '>' ? HTML_TEXT : HTML_TAG_ATTRS;
+                } else {
+                    state = c == '<' ? HTML_RAWTEXT_LT : HTML_RAWTEXT;
                 }
-                i++;
+                break;
+        }
+    }
+}
+
+template <typename Sink>
+void Html2TextConverter<Sink>::Finish() {
+    if (state == HTML_ENTITY) FlushEntity(false);
+    if (nbsp_lead) Emit("\xC2", 1);
+    if (table.depth > 0) {
+        RowEnd();
+        FlushTable();
+    }
+
+    // Remove trailing whitespace
+    sink.TrimWhitespace();
+}
+
+// The collected links as a numbered reference list after the text
+template <typename Sink>
+template <typename Out>
+void Html2TextConverter<Sink>::WriteReferences(Out& out) const {
+    if (link_count == 0) return;
+    out.Put("\n\nReferences", 12);
+    for (int i = 0; i < link_count; i++) {
+        char number[16];
+        int number_len = snprintf(number, sizeof(number), "\n%d. ", i + 1);
+        out.Put(number, (size_t)number_len);
+        const char* link = link_pool + link_offsets[i];
+        out.Put(link, strlen(link));
+    }
+}
+
+template <typename Sink>
+static Html2TextConverter<Sink>* NewConverter() {
+    auto* converter = (Html2TextConverter<Sink>*)calloc(1, sizeof(Html2TextConverter<Sink>));
+    if (converter) {
+        converter->state = HTML_TEXT;
+        converter->open_link = -1;
+    }
+    return converter;
+}
+
+struct Html2TextStream : Html2TextConverter<BufferSink> {};
+
+Html2TextStream* html2text_stream_create(size_t max_output) {
+    char* out = (char*)malloc(max_output + 1);
+    if (!out) return nullptr;
+
+    Html2TextStream* stream = (Html2TextStream*)NewConverter<BufferSink>();
+    if (!stream) {
+        free(out);
+        return nullptr;
+    }
+    stream->sink.data = out;
+    stream->sink.cap = max_output;
+    return stream;
+}
+
+bool html2text_stream_track_spans(Html2TextStream* stream, size_t max_spans) {
+    free(stream->spans);
+    stream->spans = (Html2TextSpan*)malloc(max_spans * sizeof(Html2TextSpan));
+    stream->span_cap = stream->spans ? max_spans : 0;
+    stream->span_count = 0;
+    return stream->spans != nullptr;
+}
+
+bool html2text_stream_track_headings(Html2TextStream* stream, size_t max_headings) {
+    free(stream->headings);
+    stream->headings = (Html2TextHeading*)malloc(max_headings * sizeof(Html2TextHeading));
+    stream->heading_cap = stream->headings ? max_headings : 0;
+    stream->heading_count = 0;
+    return stream->headings != nullptr;
+}
+
+Html2TextHeading* html2text_stream_take_headings(Html2TextStream* stream, size_t* count) {
+    Html2TextHeading* headings = stream->headings;
+    *count = stream->heading_count;
+    if (*count == 0) {
+        free(headings);
+        headings = nullptr;
+    } else {
+        auto* exact = (Html2TextHeading*)realloc(headings, *count * sizeof(Html2TextHeading));
+        if (exact) headings = exact;
+    }
+    stream->headings = nullptr;
+    stream->heading_count = 0;
+    stream->heading_cap = 0;
+    stream->heading_fresh = false;
+    return headings;
+}
+
+bool html2text_stream_feed(Html2TextStream* stream, const char* html, size_t len) {
+    if (stream->sink.truncated) return false;
+    stream->Feed(html, len);
+    return !stream->sink.truncated;
+}
+
+size_t html2text_stream_feed_slice(Html2TextStream* stream, const char* html, size_t len,
+                                   const Html2TextBudget* budget) {
+    if (stream->sink.truncated) return len;
+
+    bool timed = budget->max_us > 0 && budget->now_us;
+    uint32_t start = timed ? budget->now_us() : 0;
+    size_t done = 0;
+    while (done < len) {
+        size_t step = len - done < kSliceStep ? len - done : kSliceStep;
+        if (budget->max_bytes > 0) {
+            if (done >= budget->max_bytes) break;
+            if (step > budget->max_bytes - done) step = budget->max_bytes - done;
+        }
+        stream->Feed(html + done, step);
+        done += step;
+
+        // Output is full, the rest of the input would be dropped anyway
+        if (stream->sink.truncated) return len;
+        if (timed && budget->now_us() - start >= budget->max_us) break;
+    }
+    return done;
+}
+
+bool html2text_stream_full(const Html2TextStream* stream) {
+    return stream->sink.truncated;
+}
+
+const char* html2text_stream_title(const Html2TextStream* stream) {
+    return stream->title_state == TITLE_DONE ? stream->title : nullptr;
+}
+
+// Resizes the output to exactly the text plus the reference list, then
+// releases the stream
+static char* FinishText(Html2TextStream* stream) {
+    CountingSink footer = {};
+    stream->WriteReferences(footer);
+
+    BufferSink& sink = stream->sink;
+    char* exact = (char*)realloc(sink.data, sink.len + footer.len + 1);
+    if (exact) {
+        sink.data = exact;
+        sink.cap = sink.len + footer.len;
+        stream->WriteReferences(sink);
+    }
+    sink.Terminate();
+
+    char* result = sink.data;
+    free(stream->spans);
+    free(stream->headings);
+    free(stream);
+    return result;
+}
+
+char* html2text_stream_finish(Html2TextStream* stream, bool* truncated) {
+    stream->Finish();
+    if (truncated) *truncated = stream->sink.truncated;
+    return FinishText(stream);
+}
+
+bool html2text_stream_finish_document(Html2TextStream* stream, Html2TextDocument* doc) {
+    stream->Finish();
+    memset(doc, 0, sizeof(*doc));
+    doc->truncated = stream->sink.truncated;
+
+    // Links move into their own table, sized to what was actually used
+    bool ok = true;
+    if (stream->link_count > 0) {
+        doc->links = (char*)malloc(stream->link_pool_len);
+        doc->link_offsets = (uint16_t*)malloc((size_t)stream->link_count * sizeof(uint16_t));
+        ok = doc->links && doc->link_offsets;
+        if (ok) {
+            memcpy(doc->links, stream->link_pool, stream->link_pool_len);
+            for (int i = 0; i < stream->link_count; i++) {
+                doc->link_offsets[i] = (uint16_t)stream->link_offsets[i];
             }
-            break;
+            doc->link_count = (size_t)stream->link_count;
+        }
+    }
+    if (stream->span_count > 0) {
+        doc->spans = (Html2TextSpan*)realloc(stream->spans, stream->span_count * sizeof(Html2TextSpan));
+        if (!doc->spans) doc->spans = stream->spans;
+        doc->span_count = stream->span_count;
+        stream->spans = nullptr;
+    }
+
+    doc->text = FinishText(stream);
+    if (!doc->text || !ok) {
+        html2text_document_free(doc);
+        return false;
+    }
+    doc->text_len = strlen(doc->text);
+    return true;
+}
+
+void html2text_document_free(Html2TextDocument* doc) {
+    free(doc->text);
+    free(doc->spans);
+    free(doc->links);
+    free(doc->link_offsets);
+    memset(doc, 0, sizeof(*doc));
+}
+
+void html2text_stream_free(Html2TextStream* stream) {
+    if (!stream) return;
+    free(stream->sink.data);
+    free(stream->spans);
+    free(stream->headings);
+    free(stream);
+}
+
+size_t html2text_measure(const char* html, size_t len) {
+    Html2TextConverter<CountingSink>* converter = NewConverter<CountingSink>();
+    if (!converter) return SIZE_MAX;
+
+    converter->Feed(html, len);
+    converter->Finish();
+    converter->WriteReferences(converter->sink);
+    size_t size = converter->sink.len;
+    free(converter);
+    return size;
+}
+
+size_t html2text_convert_into(const char* html, size_t len, char* out, size_t out_size, bool* truncated) {
+    if (out_size == 0) return 0;
+    Html2TextConverter<BufferSink>* converter = NewConverter<BufferSink>();
+    if (!converter) {
+        out[0] = '\0';
+        return 0;
+    }
+
+    converter->sink.data = out;
+    converter->sink.cap = out_size - 1;
+    converter->Feed(html, len);
+    converter->Finish();
+    converter->WriteReferences(converter->sink);
+    converter->sink.Terminate();
+    if (truncated) *truncated = converter->sink.truncated;
+    size_t size = converter->sink.len;
+    free(converter);
+    return size;
+}
+
+#if HTML2TEXT_PARALLEL
+// Where to split a document for parallel conversion: just before a start
+// tag that forces a paragraph break, because whatever whitespace the first
+// half leaves pending is then replaced by the same two breaks. Returns 0
+// when there is no such tag in the middle half of the input. The split is
+// only a guess, the tag may turn out to be inside a comment or script.
+static size_t FindSplit(const char* html, size_t len) {
+    for (size_t i = len / 2; i + kHtmlTagMaxLen + 2 < len - len / 4; i++) {
+        if (html[i] != '<' || !IsAsciiAlpha(html[i + 1])) continue;
+        size_t name_len = 1;
+        while (name_len <= kHtmlTagMaxLen && IsAsciiAlnum(html[i + 1 + name_len])) name_len++;
+        char end = html[i + 1 + name_len];
+        if (end != '>' && end != '/' && !IsAttrSpace(end)) continue;
+        if (HtmlTagBreaks(HtmlTagLookup(html + i + 1, name_len)) == 2) return i;
+    }
+    return 0;
+}
+
+// Whether the first half probably has more links than the table holds, in
+// which case the second half can't add any. Only counts "<a " so it is
+// cheap; Stitch checks the guess.
+static bool LinksLikelyFull(const char* html, size_t len) {
+    int anchors = 0;
+    for (size_t i = 0; i + 2 < len; i++) {
+        if (html[i] == '<' && (html[i + 1] | 0x20) == 'a' && IsAttrSpace(html[i + 2]) && ++anchors > kMaxLinks) {
+            return true;
+        }
     }
-    return -3;
+    return false;
+}
+
+struct SplitJob {
+    Html2TextConverter<BufferSink>* converter;
+    const char* html;
+    size_t len;
+};
+
+static void RunSplitJob(void* arg) {
+    auto* job = (SplitJob*)arg;
+    job->converter->Feed(job->html, job->len);
+    job->converter->Finish();
 }
 
+// Appends the speculatively converted second half `b` to `a`, which has
+// consumed the first half. Returns false, leaving `a` untouched, when `a`
+// did not end in the plain top-level state `b` assumed or the halves
+// can't be joined exactly; the caller then converts the second half again.
+static bool Stitch(Html2TextConverter<BufferSink>* a, const Html2TextConverter<BufferSink>* b) {
+    const SplitLog& log = *b->split;
+    bool neutral = a->state == HTML_TEXT && !a->nbsp_lead && a->pre_depth == 0 && a->table.depth == 0 &&
+        a->table.rows == 0 && !a->table.cell_open && a->title_state != TITLE_OPEN && a->open_link < 0 &&
+        !a->sink.truncated;
+    if (!neutral || log.diverged) return false;
+    // A second <title> is text once the first one is done
+    if (a->title_state == TITLE_DONE && b->title_state != TITLE_NONE) return false;
+    if (log.links_off) {
+        // Right only if none of the dropped links would have fit
+        bool full = a->link_count == kMaxLinks || log.min_link_size == 0 ||
+            log.min_link_size > kLinkPoolSize - a->link_pool_len;
+        if (!full) return false;
+    } else if (b->link_count > 0) {
+        if (a->base_href[0] != '\0') return false;
+        if (a->link_count + b->link_count > kMaxLinks) return false;
+        if (a->link_pool_len + b->link_pool_len > kLinkPoolSize) return false;
+        if (a->link_count > 0 && log.markers_lost) return false;
+    }
+
+    BufferSink& sink = a->sink;
+    const BufferSink& tail = b->sink;
+    if (tail.len == 0) {
+        sink.TrimWhitespace();
+    } else if (sink.len > 0 && log.lead_seen) {
+        // Join the halves the way Emit would have
+        if (log.lead_breaks > 0) {
+            sink.TrimSpaces();
+            int have = 0;
+            while (have < log.lead_breaks && sink.Back((size_t)have) == '\n') have++;
+            for (; have < log.lead_breaks; have++) sink.Put("\n", 1);
+        } else if (log.lead_space && sink.Back(0) != ' ' && sink.Back(0) != '\n') {
+            sink.Put(" ", 1);
+        }
+    }
+
+    size_t copied = 0;
+    for (int m = 0; m < log.marker_count && a->link_count > 0; m++) {
+        char marker[16];
+        size_t pos = log.marker_pos[m];
+        size_t old_len = (size_t)snprintf(marker, sizeof(marker), "[%d]", log.marker_link[m] + 1);
+        int marker_len = snprintf(marker, sizeof(marker), "[%d]", a->link_count + log.marker_link[m] + 1);
+        sink.Put(tail.data + copied, pos - copied);
+        sink.Put(marker, (size_t)marker_len);
+        copied = pos + old_len;
+    }
+    sink.Put(tail.data + copied, tail.len - copied);
+    if (tail.truncated) sink.truncated = true;
+
+    for (int i = 0; i < b->link_count; i++) {
+        a->link_offsets[a->link_count + i] = a->link_pool_len + b->link_offsets[i];
+    }
+    memcpy(a->link_pool + a->link_pool_len, b->link_pool, b->link_pool_len);
+    a->link_pool_len += b->link_pool_len;
+    a->link_count += b->link_count;
+    return true;
+}
+
+size_t html2text_convert_parallel(const char* html, size_t len, char* out, size_t out_size, bool* truncated,
+                                  const Html2TextWorker* worker) {
+    size_t split = len >= kParallelMin ? FindSplit(html, len) : 0;
+    if (split == 0 || out_size == 0) return html2text_convert_into(html, len, out, out_size, truncated);
+
+    Html2TextConverter<BufferSink>* first = NewConverter<BufferSink>();
+    Html2TextConverter<BufferSink>* second = NewConverter<BufferSink>();
+    auto* log = (SplitLog*)calloc(1, sizeof(SplitLog));
+    char* second_out = (char*)malloc(out_size);
+    if (!first || !second || !log || !second_out) {
+        free(first);
+        free(second);
+        free(log);
+        free(second_out);
+        return html2text_convert_into(html, len, out, out_size, truncated);
+    }
+
+    first->sink.data = out;
+    first->sink.cap = out_size - 1;
+    second->sink.data = second_out;
+    second->sink.cap = out_size - 1;
+    second->split = log;
+    log->links_off = LinksLikelyFull(html, split);
+
+    SplitJob job = {second, html + split, len - split};
+    worker->start(worker->ctx, RunSplitJob, &job);
+    first->Feed(html, split);
+    worker->wait(worker->ctx);
+
+    if (!Stitch(first, second)) {
+        // Misspeculated: carry on sequentially from the real state
+        first->Feed(html + split, len - split);
+        first->Finish();
+    }
+    first->WriteReferences(first->sink);
+    first->sink.Terminate();
+    if (truncated) *truncated = first->sink.truncated;
+    size_t size = first->sink.len;
+
+    free(first);
+    free(second);
+    free(log);
+    free(second_out);
+    return size;
+}
+#endif
+
 // C-style implementation that returns allocated string
 char* html2text_c(const char* html) {
     if (!html) return nullptr;
-    
+
+    // Measure first so the result is allocated at its exact size
     size_t html_len = strlen(html);
-    // Allocate result buffer (worst case: same size as input + null terminator)
-    char* result = (char*)malloc(html_len + 1);
+    size_t text_len = html2text_measure(html, html_len);
+    if (text_len == SIZE_MAX) return nullptr;
+    char* result = (char*)malloc(text_len + 1);
     if (!result) return nullptr;
-    
-    int result_pos = 0;
-    int i = 0;
-    int condition = HTML_FIRST;
-    char tmp[100];
-    
-    while (i < (int)html_len) {
-        if (local_strncmp(html + i, "<", 1) != 0) {
-            int first_place = i;
-            while (i < (int)html_len && local_strncmp(html + i, " ", 1) != 0 && local_strncmp(html + i, "<", 1) != 0) {
-                i++;
-            }
 
-            int word_length = i - first_place;
-            if (word_length > 0 && word_length < 100) {
-                int last_place = i;
-                // Skip non-alphanumeric at start/end
-                while (first_place < last_place && !isalnum(html[first_place])) first_place++;
-                while (last_place > first_place && !isalnum(html[last_place - 1])) last_place--;
-
-                word_length = last_place - first_place;
-                if (word_length > 0) {
-                    strncpy(tmp, html + first_place, word_length);
-                    tmp[word_length] = '\0';
-                    // Convert first letter to lowercase if uppercase
-                    if (isupper(tmp[0]) && isalpha(tmp[0])) tmp[0] = tolower(tmp[0]);
-                    
-                    // Copy word to result
-                    strcpy(result + result_pos, tmp);
-                    result_pos += word_length;
-                    
-                    // Add space
-                    result[result_pos++] = ' ';
-                }
-            }
-            if (i < (int)html_len && local_strncmp(html + i, "<", 1) != 0) i++;
-        } else {
-            i = SearchHtmlTag(html, i, &condition);
-            if (i == -1 || i < -1) break;
-        }
-    }
-
-    // Remove trailing space
-    if (result_pos > 0 && result[result_pos - 1] == ' ') {
-        result_pos--;
+    // Short of the measured length only if its converter couldn't be had
+    if (html2text_convert_into(html, html_len, result, text_len + 1, nullptr) != text_len) {
+        free(result);
+        return nullptr;
     }
-    
-    result[result_pos] = '\0';
     return result;
 }
 
@@ -131,9 +1771,8 @@ std::string html2text(const std::string& html) {
     if (!c_result) {
         return std::string();
     }
-    
+
     std::string result(c_result);
     free(c_result);
     return result;
 }
-
@@ -1,9 +1,132 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
-// C-style function that returns allocated string (caller must free())
+// C-style function that returns allocated string (caller must free()),
+// nullptr when out of memory
 char* html2text_c(const char* html);
 
 // C++ wrapper for compatibility
 std::string html2text(const std::string& html);
+
+// Exact length of the converted text (without the NUL), computed by a
+// pass that counts instead of writing. SIZE_MAX when out of memory, so an
+// empty page can be told apart.
+size_t html2text_measure(const char* html, size_t len);
+
+// Converts into a caller-provided buffer, truncating to out_size - 1 bytes.
+// Returns the text length, `truncated` (optional) reports if it was cut.
+size_t html2text_convert_into(const char* html, size_t len, char* out, size_t out_size, bool* truncated);
+
+#if HTML2TEXT_PARALLEL
+// Runs a job on another core for html2text_convert_parallel(). start()
+// must not block; wait() returns once the job has finished.
+struct Html2TextWorker {
+    void (*start)(void* ctx, void (*job)(void* arg), void* arg);
+    void (*wait)(void* ctx);
+    void* ctx;
+};
+
+// Same text as html2text_convert_into() unless truncated, for large
+// complete documents. The second half is converted on the worker while this
+// task does the first, on the guess that the split falls outside any tag,
+// comment, table or script. When the first half shows the guess was wrong
+// the second half is converted again here, so a bad split costs time but
+// never changes the output. Needs a second out_size buffer while it runs.
+size_t html2text_convert_parallel(const char* html, size_t len, char* out, size_t out_size, bool* truncated,
+                                  const Html2TextWorker* worker);
+#endif
+
+// Style bits of an Html2TextSpan. The low 3 bits hold the heading level
+// (1-6), 0 for body text.
+enum : uint8_t {
+    HTML2TEXT_HEADING_MASK = 0x07,
+    HTML2TEXT_BOLD = 0x08,
+    HTML2TEXT_ITALIC = 0x10,
+    HTML2TEXT_CODE = 0x20,
+    HTML2TEXT_LINK = 0x40,
+};
+
+// A styled run of the output text. Unstyled text has no span.
+struct Html2TextSpan {
+    uint32_t offset;
+    uint16_t length;
+    uint8_t style;
+    uint8_t link;       // index into the link table when HTML2TEXT_LINK is set
+};
+
+// Text plus its styling side table, all owned by the document
+struct Html2TextDocument {
+    char* text;
+    size_t text_len;
+    bool truncated;
+    Html2TextSpan* spans;
+    size_t span_count;
+    char* links;            // NUL-separated URLs, see link_offsets
+    uint16_t* link_offsets;
+    size_t link_count;
+};
+
+// Streaming conversion: feed the HTML as it arrives from the network.
+// Output is capped at max_output bytes, further text is dropped.
+struct Html2TextStream;
+
+Html2TextStream* html2text_stream_create(size_t max_output);
+
+// Records up to max_spans styled runs while converting. Call before the
+// first feed; returns false if the table can't be allocated.
+bool html2text_stream_track_spans(Html2TextStream* stream, size_t max_spans);
+
+// A heading in the output text
+struct Html2TextHeading {
+    uint32_t offset;    // of its first character
+    uint8_t level;      // 1-6
+};
+
+// Records up to max_headings headings while converting, for an outline of
+// the page. Call before the first feed; returns false if the table can't be
+// allocated.
+bool html2text_stream_track_headings(Html2TextStream* stream, size_t max_headings);
+
+// Hands over the headings recorded so far (caller must free()), nullptr if
+// there are none. Call before finishing the stream.
+Html2TextHeading* html2text_stream_take_headings(Html2TextStream* stream, size_t* count);
+
+// Returns false once the output is full and further input is pointless
+bool html2text_stream_feed(Html2TextStream* stream, const char* html, size_t len);
+
+// Limits for one slice of cooperative conversion; 0 means no limit. The
+// time limit needs a microsecond clock and is checked every few hundred
+// bytes, so a slice can overrun it slightly.
+struct Html2TextBudget {
+    size_t max_bytes;
+    uint32_t max_us;
+    uint32_t (*now_us)();
+};
+
+// Converts input until the budget is spent and returns how many bytes were
+// consumed. Call again with the remainder after yielding to other tasks.
+size_t html2text_stream_feed_slice(Html2TextStream* stream, const char* html, size_t len,
+                                   const Html2TextBudget* budget);
+
+// True once the output is full and further input is pointless
+bool html2text_stream_full(const Html2TextStream* stream);
+
+// The page <title>, available as soon as its end tag has been parsed
+// (nullptr until then). Owned by the stream.
+const char* html2text_stream_title(const Html2TextStream* stream);
+
+// Completes conversion and destroys the stream. Returns the text
+// (caller must free()), `truncated` is set when output hit max_output.
+char* html2text_stream_finish(Html2TextStream* stream, bool* truncated);
+
+// Destroys a stream without producing output
+void html2text_stream_free(Html2TextStream* stream);
+
+// Like html2text_stream_finish(), but also hands over the span and link
+// tables. Returns false when out of memory (the stream is still destroyed).
+bool html2text_stream_finish_document(Html2TextStream* stream, Html2TextDocument* doc);
+
+void html2text_document_free(Html2TextDocument* doc);
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Tag name classification through a perfect hash that is built at compile
+// time. Looking up a tag is one hash over its (short) name, one table load
+// and one name compare; the tables are constexpr.
+
+enum HtmlTagClass : uint8_t {
+    HTML_TAG_INLINE,
+    HTML_TAG_BLOCK,
+    HTML_TAG_RAWTEXT,   // content is not markup and is dropped
+    HTML_TAG_VOID,      // never has content or an end tag
+    HTML_TAG_SKIP,      // content is markup we don't render, dropped
+};
+
+// One id per known tag, in the same order as kHtmlTags
+enum HtmlTagId : uint8_t {
+    TAG_UNKNOWN,
+    TAG_A, TAG_ABBR, TAG_ADDRESS, TAG_AREA, TAG_ARTICLE, TAG_ASIDE,
+    TAG_B, TAG_BASE, TAG_BLOCKQUOTE, TAG_BODY, TAG_BR,
+    TAG_CANVAS, TAG_CAPTION, TAG_CITE, TAG_CODE, TAG_COL,
+    TAG_DD, TAG_DETAILS, TAG_DFN, TAG_DIV, TAG_DL, TAG_DT,
+    TAG_EM, TAG_EMBED,
+    TAG_FIGCAPTION, TAG_FIGURE, TAG_FOOTER, TAG_FORM,
+    TAG_H1, TAG_H2, TAG_H3, TAG_H4, TAG_H5, TAG_H6, TAG_HEAD, TAG_HEADER, TAG_HR, TAG_HTML,
+    TAG_I, TAG_IFRAME, TAG_IMG, TAG_INPUT,
+    TAG_KBD,
+    TAG_LI, TAG_LINK,
+    TAG_MAIN, TAG_META,
+    TAG_NAV, TAG_NOSCRIPT,
+    TAG_OBJECT, TAG_OL,
+    TAG_P, TAG_PARAM, TAG_PRE,
+    TAG_SAMP, TAG_SCRIPT, TAG_SECTION, TAG_SELECT, TAG_SOURCE, TAG_SPAN, TAG_STRONG,
+    TAG_STYLE, TAG_SUMMARY, TAG_SVG,
+    TAG_TABLE, TAG_TBODY, TAG_TD, TAG_TEMPLATE, TAG_TEXTAREA, TAG_TFOOT, TAG_TH, TAG_THEAD,
+    TAG_TITLE, TAG_TR, TAG_TRACK, TAG_TT,
+    TAG_UL,
+    TAG_VAR,
+    TAG_WBR,
+    TAG_COUNT,
+};
+
+constexpr size_t kHtmlTagMaxLen = 10;   // "blockquote", "figcaption"
+
+// Names are stored inline so a lookup never leaves the table
+struct HtmlTagDef {
+    char name[kHtmlTagMaxLen + 1];
+    uint8_t len;
+    HtmlTagClass cls;
+    uint8_t breaks;     // line breaks forced around the element
+};
+
+static constexpr size_t HtmlConstLen(const char* s) {
+    size_t len = 0;
+    while (s[len] != '\0') len++;
+    return len;
+}
+
+#define HTML_TAG(name, cls, breaks) {name, (uint8_t)HtmlConstLen(name), cls, breaks}
+
+static constexpr HtmlTagDef kHtmlTags[TAG_COUNT] = {
+    {"", 0, HTML_TAG_INLINE, 0},
+    HTML_TAG("a", HTML_TAG_INLINE, 0),
+    HTML_TAG("abbr", HTML_TAG_INLINE, 0),
+    HTML_TAG("address", HTML_TAG_BLOCK, 1),
+    HTML_TAG("area", HTML_TAG_VOID, 0),
+    HTML_TAG("article", HTML_TAG_BLOCK, 1),
+    HTML_TAG("aside", HTML_TAG_BLOCK, 1),
+    HTML_TAG("b", HTML_TAG_INLINE, 0),
+    HTML_TAG("base", HTML_TAG_VOID, 0),
+    HTML_TAG("blockquote", HTML_TAG_BLOCK, 2),
+    HTML_TAG("body", HTML_TAG_BLOCK, 0),
+    HTML_TAG("br", HTML_TAG_VOID, 0),
+    HTML_TAG("canvas", HTML_TAG_SKIP, 0),
+    HTML_TAG("caption", HTML_TAG_BLOCK, 1),
+    HTML_TAG("cite", HTML_TAG_INLINE, 0),
+    HTML_TAG("code", HTML_TAG_INLINE, 0),
+    HTML_TAG("col", HTML_TAG_VOID, 0),
+    HTML_TAG("dd", HTML_TAG_BLOCK, 1),
+    HTML_TAG("details", HTML_TAG_BLOCK, 1),
+    HTML_TAG("dfn", HTML_TAG_INLINE, 0),
+    HTML_TAG("div", HTML_TAG_BLOCK, 1),
+    HTML_TAG("dl", HTML_TAG_BLOCK, 2),
+    HTML_TAG("dt", HTML_TAG_BLOCK, 1),
+    HTML_TAG("em", HTML_TAG_INLINE, 0),
+    HTML_TAG("embed", HTML_TAG_VOID, 0),
+    HTML_TAG("figcaption", HTML_TAG_BLOCK, 1),
+    HTML_TAG("figure", HTML_TAG_BLOCK, 1),
+    HTML_TAG("footer", HTML_TAG_BLOCK, 1),
+    HTML_TAG("form", HTML_TAG_BLOCK, 2),
+    HTML_TAG("h1", HTML_TAG_BLOCK, 2),
+    HTML_TAG("h2", HTML_TAG_BLOCK, 2),
+    HTML_TAG("h3", HTML_TAG_BLOCK, 2),
+    HTML_TAG("h4", HTML_TAG_BLOCK, 2),
+    HTML_TAG("h5", HTML_TAG_BLOCK, 2),
+    HTML_TAG("h6", HTML_TAG_BLOCK, 2),
+    HTML_TAG("head", HTML_TAG_BLOCK, 0),
+    HTML_TAG("header", HTML_TAG_BLOCK, 1),
+    HTML_TAG("hr", HTML_TAG_VOID, 2),
+    HTML_TAG("html", HTML_TAG_BLOCK, 0),
+    HTML_TAG("i", HTML_TAG_INLINE, 0),
+    HTML_TAG("iframe", HTML_TAG_SKIP, 0),
+    HTML_TAG("img", HTML_TAG_VOID, 0),
+    HTML_TAG("input", HTML_TAG_VOID, 0),
+    HTML_TAG("kbd", HTML_TAG_INLINE, 0),
+    HTML_TAG("li", HTML_TAG_BLOCK, 1),
+    HTML_TAG("link", HTML_TAG_VOID, 0),
+    HTML_TAG("main", HTML_TAG_BLOCK, 1),
+    HTML_TAG("meta", HTML_TAG_VOID, 0),
+    HTML_TAG("nav", HTML_TAG_BLOCK, 1),
+    HTML_TAG("noscript", HTML_TAG_INLINE, 0),
+    HTML_TAG("object", HTML_TAG_SKIP, 0),
+    HTML_TAG("ol", HTML_TAG_BLOCK, 2),
+    HTML_TAG("p", HTML_TAG_BLOCK, 2),
+    HTML_TAG("param", HTML_TAG_VOID, 0),
+    HTML_TAG("pre", HTML_TAG_BLOCK, 2),
+    HTML_TAG("samp", HTML_TAG_INLINE, 0),
+    HTML_TAG("script", HTML_TAG_RAWTEXT, 0),
+    HTML_TAG("section", HTML_TAG_BLOCK, 1),
+    HTML_TAG("select", HTML_TAG_SKIP, 0),
+    HTML_TAG("source", HTML_TAG_VOID, 0),
+    HTML_TAG("span", HTML_TAG_INLINE, 0),
+    HTML_TAG("strong", HTML_TAG_INLINE, 0),
+    HTML_TAG("style", HTML_TAG_RAWTEXT, 0),
+    HTML_TAG("summary", HTML_TAG_BLOCK, 1),
+    HTML_TAG("svg", HTML_TAG_SKIP, 0),
+    HTML_TAG("table", HTML_TAG_BLOCK, 2),
+    HTML_TAG("tbody", HTML_TAG_BLOCK, 0),
+    HTML_TAG("td", HTML_TAG_BLOCK, 0),
+    HTML_TAG("template", HTML_TAG_SKIP, 0),
+    HTML_TAG("textarea", HTML_TAG_RAWTEXT, 0),
+    HTML_TAG("tfoot", HTML_TAG_BLOCK, 0),
+    HTML_TAG("th", HTML_TAG_BLOCK, 0),
+    HTML_TAG("thead", HTML_TAG_BLOCK, 0),
+    HTML_TAG("title", HTML_TAG_RAWTEXT, 0),
+    HTML_TAG("tr", HTML_TAG_BLOCK, 0),
+    HTML_TAG("track", HTML_TAG_VOID, 0),
+    HTML_TAG("tt", HTML_TAG_INLINE, 0),
+    HTML_TAG("ul", HTML_TAG_BLOCK, 2),
+    HTML_TAG("var", HTML_TAG_INLINE, 0),
+    HTML_TAG("wbr", HTML_TAG_VOID, 0),
+};
+
+#undef HTML_TAG
+constexpr unsigned kHtmlTagHashBits = 9;
+
+// FNV-1a over the name with ASCII case folded; the top bits pick the slot
+static constexpr uint32_t HtmlTagHash(const char* name, size_t len, uint32_t seed) {
+    uint32_t hash = seed;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (uint8_t)(name[i] | 0x20)) * 16777619u;
+    }
+    return hash >> (32 - kHtmlTagHashBits);
+}
+
+struct HtmlTagTable {
+    uint32_t seed;
+    uint8_t slots[1u << kHtmlTagHashBits];  // HtmlTagId, TAG_UNKNOWN if empty
+};
+
+// Tries FNV seeds until every known name lands in its own slot
+static constexpr HtmlTagTable BuildHtmlTagTable() {
+    for (uint32_t seed = 2166136261u; seed < 2166136261u + 100000u; seed++) {
+        HtmlTagTable table = {};
+        bool collision = false;
+        for (int id = 1; id < TAG_COUNT && !collision; id++) {
+            uint32_t slot = HtmlTagHash(kHtmlTags[id].name, kHtmlTags[id].len, seed);
+            if (table.slots[slot] != TAG_UNKNOWN) {
+                collision = true;
+            } else {
+                table.slots[slot] = (uint8_t)id;
+            }
+        }
+        if (!collision) {
+            table.seed = seed;
+            return table;
+        }
+    }
+    return HtmlTagTable{};
+}
+
+static constexpr HtmlTagTable kHtmlTagTable = BuildHtmlTagTable();
+static_assert(kHtmlTagTable.seed != 0, "no perfect hash seed for the HTML tag set");
+
+// Case-insensitive tag name lookup
+static inline HtmlTagId HtmlTagLookup(const char* name, size_t len) {
+    if (len == 0 || len > kHtmlTagMaxLen) return TAG_UNKNOWN;
+    uint8_t id = kHtmlTagTable.slots[HtmlTagHash(name, len, kHtmlTagTable.seed)];
+    const HtmlTagDef& def = kHtmlTags[id];
+    if (def.len != len) return TAG_UNKNOWN;
+    for (size_t i = 0; i < len; i++) {
+        if ((char)(name[i] | 0x20) != def.name[i]) return TAG_UNKNOWN;
+    }
+    return (HtmlTagId)id;
+}
+
+static inline HtmlTagClass HtmlTagClassOf(HtmlTagId id) {
+    return kHtmlTags[id].cls;
+}
+
+static inline int HtmlTagBreaks(HtmlTagId id) {
+    return kHtmlTags[id].breaks;
+}
+
+static inline int HtmlTagHeadingLevel(HtmlTagId id) {
+    return id >= TAG_H1 && id <= TAG_H6 ? id - TAG_H1 + 1 : 0;
+}
@@ -0,0 +1,92 @@
+#include "text_layout.h"
+
+// Bytes in the UTF-8 sequence that starts with lead
+static size_t SequenceLength(uint8_t lead) {
+    if (lead < 0xC0) return 1;     // ASCII, or a stray continuation byte
+    if (lead < 0xE0) return 2;
+    if (lead < 0xF0) return 3;
+    return 4;
+}
+
+// LVGL's LV_TXT_BREAK_CHARS: a line may end after any of these
+static bool IsBreakChar(uint8_t c) {
+    switch (c) {
+        case ' ': case ',': case '.': case ';': case ':': case '-': case '_': case ')': case ']': case '}':
+            return true;
+        default:
+            return false;
+    }
+}
+
+size_t text_layout_next_line(const char* text, size_t len, size_t start, const TextMetrics* metrics, int32_t width) {
+    int32_t x = 0;
+    size_t wrap = start;    // just after the last break character on the line
+    size_t pos = start;
+    while (pos < len) {
+        uint8_t c = (uint8_t)text[pos];
+        if (c == '\n') return pos + 1;
+
+        int32_t advance = c < 128 ? metrics->advance[c] : metrics->other;
+        if (x + advance > width && pos > start) {
+            // A space may hang off the end of the line it ends
+            if (c == ' ') return pos + 1;
+            return wrap > start ? wrap : pos;
+        }
+        x += advance;
+
+        size_t next = pos + SequenceLength(c);
+        pos = next < len ? next : len;
+        if (IsBreakChar(c)) wrap = pos;
+    }
+    return len;
+}
+
+size_t text_layout_wrap(const char* text, size_t len, const TextMetrics* metrics, int32_t width,
+                        uint32_t* line_starts, size_t max_lines) {
+    size_t lines = 0;
+    size_t pos = 0;
+    bool soft = false;
+    while (lines < max_lines) {
+        if (line_starts) {
+            line_starts[lines] = (uint32_t)pos | (soft ? TEXT_LAYOUT_SOFT : 0);
+        }
+        lines++;
+
+        size_t end = text_layout_next_line(text, len, pos, metrics, width);
+        if (end >= len) break;
+        soft = text[end - 1] == ' ';
+        pos = end;
+    }
+    return lines;
+}
+
+void text_layout_bake(char* text, const uint32_t* line_starts, size_t line_count) {
+    for (size_t i = 0; i < line_count; i++) {
+        if (line_starts[i] & TEXT_LAYOUT_SOFT) {
+            text[text_layout_offset(line_starts[i]) - 1] = '\n';
+        }
+    }
+}
+
+void text_layout_unbake(char* text, const uint32_t* line_starts, size_t line_count) {
+    for (size_t i = 0; i < line_count; i++) {
+        if (line_starts[i] & TEXT_LAYOUT_SOFT) {
+            text[text_layout_offset(line_starts[i]) - 1] = ' ';
+        }
+    }
+}
+
+size_t text_layout_find_line(const uint32_t* line_starts, size_t line_count, size_t offset) {
+    // Last line that starts at or before offset
+    size_t low = 0;
+    size_t high = line_count;
+    while (high - low > 1) {
+        size_t mid = low + (high - low) / 2;
+        if (text_layout_offset(line_starts[mid]) <= offset) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Line wrapping of plain text, done without LVGL so it can run on a worker
+// task. The caller snapshots the font into TextMetrics (under the LVGL lock)
+// and the layout only reads that.
+
+// Glyph advances of one font in pixels, letter spacing included
+struct TextMetrics {
+    uint8_t advance[128];   // ASCII
+    uint8_t other;          // any non-ASCII character, the widest ASCII advance
+    int32_t line_height;    // line spacing included
+};
+
+// Set on a line start when the line follows a soft break: a space that
+// wrapped the line, which text_layout_bake() turns into '\n'
+constexpr uint32_t TEXT_LAYOUT_SOFT = 0x80000000u;
+
+static inline uint32_t text_layout_offset(uint32_t line_start) {
+    return line_start & ~TEXT_LAYOUT_SOFT;
+}
+
+// Greedy word wrap the way an LVGL label wraps: a line ends at '\n', after
+// the last break character (" ,.;:-_)]}") that fits, or inside a word that
+// is wider than the line. Returns where the line starting at start ends,
+// which is where the next one begins.
+size_t text_layout_next_line(const char* text, size_t len, size_t start, const TextMetrics* metrics, int32_t width);
+
+// Wraps the whole text, storing the start of each line in line_starts, and
+// returns the line count, at most max_lines. With line_starts nullptr the
+// lines are only counted.
+size_t text_layout_wrap(const char* text, size_t len, const TextMetrics* metrics, int32_t width,
+                        uint32_t* line_starts, size_t max_lines);
+
+// Turns the spaces at soft breaks into '\n', so a label of the wrap width
+// shows exactly these lines without wrapping them again; unbake undoes it
+// before the text is wrapped anew.
+void text_layout_bake(char* text, const uint32_t* line_starts, size_t line_count);
+void text_layout_unbake(char* text, const uint32_t* line_starts, size_t line_count);
+
+// Index of the line holding offset
+size_t text_layout_find_line(const uint32_t* line_starts, size_t line_count, size_t offset);
@@ -0,0 +1,663 @@
+#include "text_index.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "util/le.h"
+
+// Two files, little-endian throughout.
+//
+// pages.log holds the runs added since the last merge. Each is a 20 byte
+// header, the URL, the title and the word hashes, ascending, as varint
+// deltas. The CRC covers everything after it.
+//
+//   0  magic       u32
+//   4  crc         u32
+//   8  id          u32
+//   12 term_count  u16
+//   14 term_bytes  u16
+//   16 url_len     u8
+//   17 title_len   u8
+//   18 reserved    u16
+//
+// index.bin is the inverted file. It's only ever replaced whole by a
+// rename, so it needs no CRC. A 12 byte header, then the page table, then
+// kBuckets + 1 offsets into the postings that follow them.
+//
+//   0  magic       u32
+//   4  next_id     u32
+//   8  page_count  u16
+//   10 reserved    u16
+//   page:  id u32, url_len u8, title_len u8, url, title
+//
+// A hash's top 8 bits pick its bucket. A bucket lists its hashes ascending:
+// the low 16 bits as a varint delta from the one before, the posting count,
+// then the page ids, newest first, as varint deltas from the one before.
+constexpr uint32_t kLogMagic = 0x4c545754;      // "TWTL"
+constexpr uint32_t kIndexMagic = 0x49545754;    // "TWTI"
+constexpr size_t kRunHeaderSize = 20;
+constexpr size_t kIndexHeaderSize = 12;
+constexpr size_t kBuckets = 256;
+constexpr size_t kMergeRuns = 4;
+constexpr size_t kMaxRunTerms = 4096;
+constexpr size_t kMaxUrlLen = 255;
+constexpr size_t kMaxTitleLen = 95;
+
+struct Page {
+    uint32_t id;
+    uint32_t url_hash;
+    uint32_t offset;        // of its URL, in the log or the index
+    uint8_t url_len;
+    uint8_t title_len;
+    bool in_log;
+};
+
+// A run in the log, not merged yet
+struct Run {
+    uint32_t id;
+    uint32_t offset;        // of its terms
+    uint16_t term_count;
+    uint16_t term_bytes;
+};
+
+struct TextIndex {
+    char dir[128];
+    SemaphoreHandle_t lock;
+    Page pages[kTextIndexMaxPages];
+    size_t page_count;
+    Run runs[kMergeRuns];
+    size_t run_count;
+    uint32_t next_id;
+    uint32_t log_size;
+    uint32_t postings;              // where they start in the index
+    uint32_t buckets[kBuckets + 1];
+};
+
+static uint32_t Fnv1a(uint32_t hash, uint8_t c) {
+    return (hash ^ c) * 16777619u;
+}
+
+static uint32_t HashUrl(const char* url) {
+    uint32_t hash = 2166136261u;
+    while (*url) hash = Fnv1a(hash, (uint8_t)*url++);
+    return hash;
+}
+
+static int CompareTerms(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static size_t SortUnique(uint32_t* terms, size_t count) {
+    if (count == 0) return 0;
+    qsort(terms, count, sizeof(uint32_t), CompareTerms);
+    size_t unique = 1;
+    for (size_t i = 1; i < count; i++) {
+        if (terms[i] != terms[unique - 1]) terms[unique++] = terms[i];
+    }
+    return unique;
+}
+
+static void FilePath(const TextIndex* index, const char* name, char* path, size_t size) {
+    snprintf(path, size, "%s/%s", index->dir, name);
+}
+
+static FILE* OpenFile(const TextIndex* index, const char* name, const char* mode) {
+    char path[160];
+    FilePath(index, name, path, sizeof(path));
+    return fopen(path, mode);
+}
+
+static bool ReadAt(FILE* file, uint32_t offset, void* data, size_t len) {
+    return fseek(file, (long)offset, SEEK_SET) == 0 && fread(data, 1, len, file) == len;
+}
+
+static Page* FindPage(TextIndex* index, uint32_t id) {
+    for (size_t i = 0; i < index->page_count; i++) {
+        if (index->pages[i].id == id) return &index->pages[i];
+    }
+    return nullptr;
+}
+
+static void DropPage(TextIndex* index, Page* page) {
+    *page = index->pages[--index->page_count];
+}
+
+// Makes room for a new page: drops the URL's earlier page, then the oldest
+// if the index is still full
+static void EvictFor(TextIndex* index, uint32_t url_hash) {
+    for (size_t i = 0; i < index->page_count; i++) {
+        if (index->pages[i].url_hash == url_hash) {
+            DropPage(index, &index->pages[i]);
+            break;
+        }
+    }
+    if (index->page_count < kTextIndexMaxPages) return;
+    Page* oldest = &index->pages[0];
+    for (size_t i = 1; i < index->page_count; i++) {
+        if (index->pages[i].id < oldest->id) oldest = &index->pages[i];
+    }
+    DropPage(index, oldest);
+}
+
+// Decodes a run's terms (caller must free())
+static uint32_t* ReadRunTerms(FILE* log, const Run* run) {
+    auto* bytes = (uint8_t*)malloc(run->term_bytes > 0 ? run->term_bytes : 1);
+    auto* terms = (uint32_t*)malloc((run->term_count > 0 ? run->term_count : 1) * sizeof(uint32_t));
+    bool ok = bytes && terms && ReadAt(log, run->offset, bytes, run->term_bytes);
+    const uint8_t* p = bytes;
+    const uint8_t* end = bytes + run->term_bytes;
+    uint32_t term = 0;
+    for (size_t i = 0; ok && i < run->term_count; i++) {
+        uint32_t delta = 0;
+        size_t len = get_varint(p, end, &delta);
+        ok = len > 0;
+        p += len;
+        term += delta;
+        terms[i] = term;
+    }
+    free(bytes);
+    if (!ok) {
+        free(terms);
+        return nullptr;
+    }
+    return terms;
+}
+
+// Reads the header, page table and bucket offsets of index.bin
+static void LoadIndex(TextIndex* index) {
+    index->page_count = 0;
+    index->postings = 0;
+    memset(index->buckets, 0, sizeof(index->buckets));
+    FILE* file = OpenFile(index, "index.bin", "rb");
+    if (!file) return;
+
+    uint8_t header[kIndexHeaderSize];
+    size_t count = 0;
+    uint32_t offset = kIndexHeaderSize;
+    if (ReadAt(file, 0, header, kIndexHeaderSize) && get_le32(header) == kIndexMagic) {
+        index->next_id = get_le32(header + 4);
+        count = get_le16(header + 8);
+    }
+    for (size_t i = 0; i < count && i < kTextIndexMaxPages; i++) {
+        uint8_t entry[6];
+        if (!ReadAt(file, offset, entry, sizeof(entry))) break;
+        Page* page = &index->pages[index->page_count];
+        page->id = get_le32(entry);
+        page->url_len = entry[4];
+        page->title_len = entry[5];
+        page->offset = offset + (uint32_t)sizeof(entry);
+        page->in_log = false;
+        // The file has no CRC; lengths past the buffers they're read into
+        // mean it's damaged, and the index starts empty
+        if (page->url_len == 0 || page->title_len > kMaxTitleLen) break;
+        char url[kMaxUrlLen + 1];
+        if (!ReadAt(file, page->offset, url, page->url_len)) break;
+        url[page->url_len] = '\0';
+        page->url_hash = HashUrl(url);
+        offset = page->offset + page->url_len + page->title_len;
+        index->page_count++;
+    }
+
+    auto* table = (uint8_t*)malloc((kBuckets + 1) * 4);
+    if (table && index->page_count == count && ReadAt(file, offset, table, (kBuckets + 1) * 4)) {
+        for (size_t i = 0; i <= kBuckets; i++) {
+            index->buckets[i] = get_le32(table + i * 4);
+        }
+        index->postings = offset + (kBuckets + 1) * 4;
+    } else {
+        index->page_count = 0;
+    }
+    free(table);
+    fclose(file);
+}
+
+// Indexes the log's runs; returns false if it ends in a damaged one
+static bool ScanLog(TextIndex* index) {
+    index->run_count = 0;
+    index->log_size = 0;
+    FILE* log = OpenFile(index, "pages.log", "rb");
+    if (!log) return true;
+
+    fseek(log, 0, SEEK_END);
+    long file_size = ftell(log);
+    uint32_t offset = 0;
+    uint8_t header[kRunHeaderSize];
+    while (index->run_count < kMergeRuns && ReadAt(log, offset, header, kRunHeaderSize)) {
+        size_t url_len = header[16];
+        size_t title_len = header[17];
+        size_t body = url_len + title_len + get_le16(header + 14);
+        if (get_le32(header) != kLogMagic || url_len == 0 || title_len > kMaxTitleLen ||
+            offset + kRunHeaderSize + body > (size_t)file_size) {
+            break;
+        }
+        auto* record = (uint8_t*)malloc(kRunHeaderSize + body);
+        bool ok = record && ReadAt(log, offset, record, kRunHeaderSize + body) &&
+                  get_le32(record + 4) == crc32_update(0, record + 8, kRunHeaderSize + body - 8);
+        if (ok) {
+            char url[kMaxUrlLen + 1];
+            memcpy(url, record + kRunHeaderSize, url_len);
+            url[url_len] = '\0';
+            uint32_t id = get_le32(header + 8);
+            EvictFor(index, HashUrl(url));
+            index->pages[index->page_count++] = {
+                id, HashUrl(url), offset + (uint32_t)kRunHeaderSize, (uint8_t)url_len, (uint8_t)title_len, true};
+            index->runs[index->run_count++] = {
+                id, offset + (uint32_t)(kRunHeaderSize + url_len + title_len), (uint16_t)get_le16(header + 12),
+                (uint16_t)get_le16(header + 14)};
+            if (id >= index->next_id) index->next_id = id + 1;
+        }
+        free(record);
+        if (!ok) break;
+        offset += (uint32_t)(kRunHeaderSize + body);
+    }
+    fclose(log);
+    index->log_size = offset;
+    return offset == (uint32_t)file_size;
+}
+
+// Reads a bucket's postings out of index.bin (caller must free()), nullptr
+// if it's empty
+static uint8_t* ReadBucket(TextIndex* index, FILE* file, size_t bucket, size_t* len) {
+    uint32_t start = index->buckets[bucket];
+    uint32_t end = index->buckets[bucket + 1];
+    *len = end > start ? end - start : 0;
+    if (!file || *len == 0) return nullptr;
+    auto* bytes = (uint8_t*)malloc(*len);
+    if (bytes && !ReadAt(file, index->postings + start, bytes, *len)) {
+        free(bytes);
+        return nullptr;
+    }
+    return bytes;
+}
+
+// Calls visit(term, id) for each posting of a bucket slice, in order
+template <typename Visit>
+static bool DecodeBucket(size_t bucket, const uint8_t* p, size_t len, Visit visit) {
+    const uint8_t* end = p + len;
+    uint32_t low = 0;
+    while (p < end) {
+        uint32_t delta = 0;
+        uint32_t count = 0;
+        size_t a = get_varint(p, end, &delta);
+        size_t b = a > 0 ? get_varint(p + a, end, &count) : 0;
+        if (b == 0) return false;
+        p += a + b;
+        low += delta;
+        uint32_t id = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            size_t n = get_varint(p, end, &delta);
+            if (n == 0) return false;
+            p += n;
+            id = i == 0 ? delta : id - delta;
+            visit((uint32_t)bucket << 16 | low, id);
+        }
+    }
+    return true;
+}
+
+struct Posting {
+    uint32_t term;
+    uint32_t id;
+};
+
+// Terms ascending, then ids newest first
+static int ComparePostings(const void* a, const void* b) {
+    const auto* x = (const Posting*)a;
+    const auto* y = (const Posting*)b;
+    if (x->term != y->term) return x->term < y->term ? -1 : 1;
+    return x->id > y->id ? -1 : (x->id < y->id ? 1 : 0);
+}
+
+// Grows a malloc'd array to hold one more element
+static bool Reserve(Posting** items, size_t count, size_t* capacity) {
+    if (count < *capacity) return true;
+    size_t grown = *capacity > 0 ? *capacity * 2 : 64;
+    auto* larger = (Posting*)realloc(*items, grown * sizeof(Posting));
+    if (!larger) return false;
+    *items = larger;
+    *capacity = grown;
+    return true;
+}
+
+static bool WriteBucket(FILE* out, const Posting* items, size_t count, uint32_t* written) {
+    uint8_t buffer[16];
+    uint32_t low = 0;
+    for (size_t i = 0; i < count;) {
+        size_t same = i + 1;
+        while (same < count && items[same].term == items[i].term) same++;
+        size_t len = put_varint(buffer, (items[i].term & 0xFFFF) - low);
+        len += put_varint(buffer + len, (uint32_t)(same - i));
+        low = items[i].term & 0xFFFF;
+        uint32_t id = 0;
+        for (size_t j = i; j < same; j++) {
+            len += put_varint(buffer + len, j == i ? items[j].id : id - items[j].id);
+            id = items[j].id;
+            if (fwrite(buffer, 1, len, out) != len) return false;
+            *written += (uint32_t)len;
+            len = 0;
+        }
+        i = same;
+    }
+    return true;
+}
+
+// Writes the live pages' postings, from index.bin and the log, to a new
+// index.bin, one bucket at a time so only a bucket's postings are in RAM.
+// The log is deleted once the new file is in place.
+static bool Merge(TextIndex* index) {
+    FILE* old = OpenFile(index, "index.bin", "rb");
+    FILE* log = OpenFile(index, "pages.log", "rb");
+    FILE* out = OpenFile(index, "index.tmp", "wb");
+    uint32_t* run_terms[kMergeRuns] = {};
+    size_t run_pos[kMergeRuns] = {};
+    Posting* items = nullptr;
+    size_t capacity = 0;
+    bool ok = out != nullptr && (log || index->run_count == 0);
+    for (size_t r = 0; ok && r < index->run_count; r++) {
+        run_terms[r] = FindPage(index, index->runs[r].id) ? ReadRunTerms(log, &index->runs[r]) : nullptr;
+    }
+
+    // Header and page table; the pages' offsets move once it's in place
+    uint8_t header[kIndexHeaderSize] = {};
+    put_le32(header, kIndexMagic);
+    put_le32(header + 4, index->next_id);
+    put_le16(header + 8, (uint32_t)index->page_count);
+    ok = ok && fwrite(header, 1, kIndexHeaderSize, out) == kIndexHeaderSize;
+    uint32_t offset = kIndexHeaderSize;
+    uint32_t new_offsets[kTextIndexMaxPages];
+    for (size_t i = 0; ok && i < index->page_count; i++) {
+        const Page* page = &index->pages[i];
+        uint8_t entry[6 + kMaxUrlLen + kMaxTitleLen];
+        put_le32(entry, page->id);
+        entry[4] = page->url_len;
+        entry[5] = page->title_len;
+        size_t len = 6 + page->url_len + page->title_len;
+        FILE* from = page->in_log ? log : old;
+        ok = from && ReadAt(from, page->offset, entry + 6, len - 6) && fwrite(entry, 1, len, out) == len;
+        new_offsets[i] = offset + 6;
+        offset += (uint32_t)len;
+    }
+    uint32_t table_offset = offset;
+    auto* table = (uint8_t*)calloc(kBuckets + 1, 4);
+    ok = ok && table && fwrite(table, 1, (kBuckets + 1) * 4, out) == (kBuckets + 1) * 4;
+
+    uint32_t written = 0;
+    for (size_t bucket = 0; ok && bucket < kBuckets; bucket++) {
+        put_le32(table + bucket * 4, written);
+        size_t count = 0;
+        size_t len = 0;
+        uint8_t* bytes = ReadBucket(index, old, bucket, &len);
+        if (bytes) {
+            ok = DecodeBucket(bucket, bytes, len, [&](uint32_t term, uint32_t id) {
+                if (ok && FindPage(index, id)) {
+                    ok = Reserve(&items, count, &capacity);
+                    if (ok) items[count++] = {term, id};
+                }
+            }) && ok;
+            free(bytes);
+        }
+        for (size_t r = 0; ok && r < index->run_count; r++) {
+            const uint32_t* terms = run_terms[r];
+            while (terms && run_pos[r] < index->runs[r].term_count && terms[run_pos[r]] >> 16 == bucket) {
+                ok = Reserve(&items, count, &capacity);
+                if (!ok) break;
+                items[count++] = {terms[run_pos[r]++], index->runs[r].id};
+            }
+        }
+        if (ok && count > 0) {
+            qsort(items, count, sizeof(Posting), ComparePostings);
+            ok = WriteBucket(out, items, count, &written);
+        }
+    }
+    ok = ok && fseek(out, (long)table_offset, SEEK_SET) == 0;
+    if (ok) {
+        put_le32(table + kBuckets * 4, written);
+        ok = fwrite(table, 1, (kBuckets + 1) * 4, out) == (kBuckets + 1) * 4 && fflush(out) == 0;
+    }
+    if (ok) fsync(fileno(out));
+
+    free(items);
+    for (size_t r = 0; r < index->run_count; r++) free(run_terms[r]);
+    if (out) fclose(out);
+    if (old) fclose(old);
+    if (log) fclose(log);
+
+    char from[160];
+    char to[160];
+    FilePath(index, "index.tmp", from, sizeof(from));
+    FilePath(index, "index.bin", to, sizeof(to));
+    // FAT won't rename over an existing file
+    if (ok && rename(from, to) != 0) {
+        remove(to);
+        ok = rename(from, to) == 0;
+    }
+    if (!ok) {
+        remove(from);
+        free(table);
+        return false;
+    }
+
+    FilePath(index, "pages.log", from, sizeof(from));
+    remove(from);
+    for (size_t i = 0; i < index->page_count; i++) {
+        index->pages[i].offset = new_offsets[i];
+        index->pages[i].in_log = false;
+    }
+    index->run_count = 0;
+    index->log_size = 0;
+    for (size_t i = 0; i <= kBuckets; i++) {
+        index->buckets[i] = get_le32(table + i * 4);
+    }
+    index->postings = table_offset + (kBuckets + 1) * 4;
+    free(table);
+    return true;
+}
+
+TextIndex* text_index_open(const char* dir) {
+    auto* index = (TextIndex*)calloc(1, sizeof(TextIndex));
+    if (!index) return nullptr;
+    index->lock = xSemaphoreCreateMutex();
+    if (!index->lock || strlen(dir) >= sizeof(index->dir)) {
+        text_index_close(index);
+        return nullptr;
+    }
+    strcpy(index->dir, dir);
+    mkdir(dir, 0775);
+    char path[160];
+    FilePath(index, "index.tmp", path, sizeof(path));
+    remove(path);
+
+    LoadIndex(index);
+    // Never append after a damaged run: merge what's intact, which drops
+    // the log
+    if (!ScanLog(index) || index->run_count == kMergeRuns) {
+        Merge(index);
+    }
+    return index;
+}
+
+void text_index_close(TextIndex* index) {
+    if (!index) return;
+    if (index->lock) vSemaphoreDelete(index->lock);
+    free(index);
+}
+
+size_t text_index_terms(const char* text, size_t len, uint32_t* terms, size_t max_terms) {
+    size_t count = 0;
+    size_t i = 0;
+    while (i < len && count < max_terms) {
+        // Words are runs of letters, digits and non-ASCII bytes, folded to
+        // lower case; single characters are skipped
+        uint32_t hash = 2166136261u;
+        size_t word_len = 0;
+        for (; i < len; i++) {
+            auto c = (uint8_t)text[i];
+            bool word = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || c >= 0x80;
+            if (c >= 'A' && c <= 'Z') {
+                c = (uint8_t)(c + 'a' - 'A');
+                word = true;
+            }
+            if (!word) break;
+            hash = Fnv1a(hash, c);
+            word_len++;
+        }
+        i++;
+        if (word_len < 2) continue;
+
+        terms[count++] = (hash ^ (hash >> 24)) & 0xFFFFFF;
+        if (count == max_terms) count = SortUnique(terms, count);
+    }
+    return SortUnique(terms, count);
+}
+
+bool text_index_add(TextIndex* index, const char* url, const char* title, const uint32_t* terms, size_t count) {
+    size_t url_len = strlen(url);
+    size_t title_len = strnlen(title, kMaxTitleLen);
+    if (url_len == 0 || url_len > kMaxUrlLen) return false;
+    if (count > kMaxRunTerms) count = kMaxRunTerms;
+
+    // Varint deltas take at most 4 bytes for 24 bit hashes
+    size_t bound = kRunHeaderSize + url_len + title_len + count * 4;
+    auto* record = (uint8_t*)malloc(bound);
+    if (!record) return false;
+    size_t size = kRunHeaderSize + url_len + title_len;
+    uint32_t previous = 0;
+    for (size_t i = 0; i < count; i++) {
+        size += put_varint(record + size, terms[i] - previous);
+        previous = terms[i];
+    }
+    memcpy(record + kRunHeaderSize, url, url_len);
+    memcpy(record + kRunHeaderSize + url_len, title, title_len);
+
+    xSemaphoreTake(index->lock, portMAX_DELAY);
+    uint32_t id = index->next_id++;
+    put_le32(record, kLogMagic);
+    put_le32(record + 8, id);
+    put_le16(record + 12, (uint32_t)count);
+    put_le16(record + 14, (uint32_t)(size - kRunHeaderSize - url_len - title_len));
+    record[16] = (uint8_t)url_len;
+    record[17] = (uint8_t)title_len;
+    put_le16(record + 18, 0);
+    put_le32(record + 4, crc32_update(0, record + 8, size - 8));
+
+    FILE* log = OpenFile(index, "pages.log", "ab");
+    bool ok = log && fwrite(record, 1, size, log) == size && fflush(log) == 0;
+    if (log) {
+        fsync(fileno(log));
+        fclose(log);
+    }
+    if (ok) {
+        uint32_t url_hash = HashUrl(url);
+        EvictFor(index, url_hash);
+        index->pages[index->page_count++] = {
+            id, url_hash, index->log_size + (uint32_t)kRunHeaderSize, (uint8_t)url_len, (uint8_t)title_len, true};
+        index->runs[index->run_count++] = {
+            id, index->log_size + (uint32_t)(kRunHeaderSize + url_len + title_len), (uint16_t)count,
+            (uint16_t)(size - kRunHeaderSize - url_len - title_len)};
+        index->log_size += (uint32_t)size;
+        ok = index->run_count < kMergeRuns || Merge(index);
+        if (!ok) {
+            // The run stays in the log, but a page the index can't hold a
+            // run for is better left out
+            index->run_count--;
+            DropPage(index, FindPage(index, id));
+        }
+    } else {
+        // The log may end in a torn run now, don't append after it
+        Merge(index);
+    }
+    xSemaphoreGive(index->lock);
+
+    free(record);
+    return ok;
+}
+
+// Bit i is set for pages[i] holding the term
+static uint64_t PagesWithTerm(TextIndex* index, FILE* file, FILE* log, uint32_t term) {
+    uint64_t mask = 0;
+    auto mark = [&](uint32_t id) {
+        for (size_t i = 0; i < index->page_count; i++) {
+            if (index->pages[i].id == id) mask |= 1ull << i;
+        }
+    };
+
+    size_t bucket = term >> 16;
+    size_t len = 0;
+    uint8_t* bytes = ReadBucket(index, file, bucket, &len);
+    if (bytes) {
+        DecodeBucket(bucket, bytes, len, [&](uint32_t found, uint32_t id) {
+            if (found == term) mark(id);
+        });
+        free(bytes);
+    }
+    for (size_t r = 0; log && r < index->run_count; r++) {
+        uint32_t* terms = ReadRunTerms(log, &index->runs[r]);
+        if (terms && bsearch(&term, terms, index->runs[r].term_count, sizeof(uint32_t), CompareTerms)) {
+            mark(index->runs[r].id);
+        }
+        free(terms);
+    }
+    return mask;
+}
+
+size_t text_index_search(TextIndex* index, const char* query, uint32_t* ids, size_t max_ids) {
+    uint32_t terms[kTextIndexMaxQueryWords];
+    size_t term_count = text_index_terms(query, strlen(query), terms, kTextIndexMaxQueryWords);
+    if (term_count == 0) return 0;
+
+    xSemaphoreTake(index->lock, portMAX_DELAY);
+    FILE* file = OpenFile(index, "index.bin", "rb");
+    FILE* log = index->run_count > 0 ? OpenFile(index, "pages.log", "rb") : nullptr;
+    uint64_t mask = ~0ull;
+    for (size_t i = 0; i < term_count && mask != 0; i++) {
+        mask &= PagesWithTerm(index, file, log, terms[i]);
+    }
+    if (file) fclose(file);
+    if (log) fclose(log);
+
+    size_t count = 0;
+    for (size_t i = 0; i < index->page_count; i++) {
+        if (!(mask & (1ull << i))) continue;
+        // Insert by id, newest first, keeping the max_ids newest
+        uint32_t id = index->pages[i].id;
+        size_t at = count;
+        while (at > 0 && ids[at - 1] < id) at--;
+        if (at >= max_ids) continue;
+        size_t moved = count < max_ids ? count : max_ids - 1;
+        memmove(ids + at + 1, ids + at, (moved - at) * sizeof(uint32_t));
+        ids[at] = id;
+        if (count < max_ids) count++;
+    }
+    xSemaphoreGive(index->lock);
+    return count;
+}
+
+bool text_index_page(TextIndex* index, uint32_t id, char* url, size_t url_size, char* title, size_t title_size) {
+    xSemaphoreTake(index->lock, portMAX_DELAY);
+    const Page* page = FindPage(index, id);
+    bool ok = page && page->url_len < url_size;
+    if (ok) {
+        char text[kMaxUrlLen + kMaxTitleLen];
+        FILE* file = OpenFile(index, page->in_log ? "pages.log" : "index.bin", "rb");
+        ok = file && ReadAt(file, page->offset, text, page->url_len + page->title_len);
+        if (file) fclose(file);
+        if (ok) {
+            memcpy(url, text, page->url_len);
+            url[page->url_len] = '\0';
+            size_t title_len = page->title_len < title_size ? page->title_len : title_size - 1;
+            memcpy(title, text + page->url_len, title_len);
+            title[title_len] = '\0';
+        }
+    }
+    xSemaphoreGive(index->lock);
+    return ok;
+}
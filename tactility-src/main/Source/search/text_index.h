@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Full-text index of pages on flash. Words are ASCII-folded and hashed to
+// 24 bits; the index maps each hash to the ids of the pages holding it, so
+// a query reads one small slice per word instead of any page.
+//
+// A page added goes to the end of a log as one run: its URL, title and
+// sorted word hashes. Every few runs they're merged into the inverted file
+// (hash buckets of delta/varint coded postings), which is written anew and
+// renamed over the old one, so flash sees no rewrites in place. At most
+// kTextIndexMaxPages recent pages are kept, adding a URL again replaces its
+// earlier page.
+//
+// Calls may block on flash and are safe from any task.
+struct TextIndex;
+
+constexpr size_t kTextIndexMaxPages = 64;
+constexpr size_t kTextIndexMaxQueryWords = 8;
+
+// Opens the index in dir, creating the directory if needed
+TextIndex* text_index_open(const char* dir);
+void text_index_close(TextIndex* index);
+
+// Collects the distinct word hashes of a text, sorted, and returns their
+// count. Stops at max_terms words.
+size_t text_index_terms(const char* text, size_t len, uint32_t* terms, size_t max_terms);
+
+// Adds a page with the hashes from text_index_terms()
+bool text_index_add(TextIndex* index, const char* url, const char* title, const uint32_t* terms, size_t count);
+
+// Stores the ids of the pages holding every word of the query, newest
+// first, and returns their count
+size_t text_index_search(TextIndex* index, const char* query, uint32_t* ids, size_t max_ids);
+
+// Looks up a page found by a search; false if it has left the index since
+bool text_index_page(TextIndex* index, uint32_t id, char* url, size_t url_size, char* title, size_t title_size);
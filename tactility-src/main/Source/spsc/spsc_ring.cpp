@@ -0,0 +1,128 @@
+#include "spsc_ring.h"
+
+#include <atomic>
+#include <cstdlib>
+
+#include <freertos/task.h>
+
+struct SpscRing {
+    char* data;
+    size_t mask;
+    // Free-running positions, the offset in data is position & mask
+    std::atomic<size_t> head;       // written by the producer
+    std::atomic<size_t> tail;       // written by the consumer
+    std::atomic<bool> closed;
+    std::atomic<bool> aborted;
+    // Set by a side before it sleeps, so the other side knows whom to wake
+    std::atomic<TaskHandle_t> producer;
+    std::atomic<TaskHandle_t> consumer;
+};
+
+// Called after moving a position. The fence pairs with the one in Register:
+// either the sleeper sees the new position or we see its handle.
+static void Wake(const std::atomic<TaskHandle_t>& task) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    TaskHandle_t handle = task.load(std::memory_order_acquire);
+    if (handle) {
+        xTaskNotifyGive(handle);
+    }
+}
+
+static void Register(std::atomic<TaskHandle_t>& task) {
+    task.store(xTaskGetCurrentTaskHandle(), std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+SpscRing* spsc_ring_create(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) size <<= 1;
+
+    auto* ring = (SpscRing*)calloc(1, sizeof(SpscRing));
+    if (!ring) return nullptr;
+    ring->data = (char*)malloc(size);
+    if (!ring->data) {
+        free(ring);
+        return nullptr;
+    }
+    ring->mask = size - 1;
+    return ring;
+}
+
+void spsc_ring_free(SpscRing* ring) {
+    if (!ring) return;
+    free(ring->data);
+    free(ring);
+}
+
+size_t spsc_ring_capacity(const SpscRing* ring) {
+    return ring->mask + 1;
+}
+
+size_t spsc_ring_write_span(SpscRing* ring, char** span) {
+    size_t head = ring->head.load(std::memory_order_relaxed);
+    size_t tail = ring->tail.load(std::memory_order_acquire);
+    size_t offset = head & ring->mask;
+    size_t free_space = ring->mask + 1 - (head - tail);
+    size_t to_end = ring->mask + 1 - offset;
+    *span = ring->data + offset;
+    return free_space < to_end ? free_space : to_end;
+}
+
+size_t spsc_ring_wait_write(SpscRing* ring, char** span, TickType_t timeout) {
+    Register(ring->producer);
+    while (true) {
+        if (ring->aborted.load()) return 0;
+        size_t len = spsc_ring_write_span(ring, span);
+        if (len > 0) return len;
+        if (ulTaskNotifyTake(pdTRUE, timeout) == 0) return 0;
+    }
+}
+
+void spsc_ring_commit(SpscRing* ring, size_t len) {
+    ring->head.store(ring->head.load(std::memory_order_relaxed) + len, std::memory_order_release);
+    Wake(ring->consumer);
+}
+
+void spsc_ring_close(SpscRing* ring) {
+    ring->closed.store(true);
+    Wake(ring->consumer);
+}
+
+size_t spsc_ring_read_span(SpscRing* ring, const char** span) {
+    size_t tail = ring->tail.load(std::memory_order_relaxed);
+    size_t head = ring->head.load(std::memory_order_acquire);
+    size_t offset = tail & ring->mask;
+    size_t used = head - tail;
+    size_t to_end = ring->mask + 1 - offset;
+    *span = ring->data + offset;
+    return used < to_end ? used : to_end;
+}
+
+size_t spsc_ring_wait_read(SpscRing* ring, const char** span, TickType_t timeout) {
+    Register(ring->consumer);
+    while (true) {
+        size_t len = spsc_ring_read_span(ring, span);
+        if (len > 0) return len;
+        // The last commit may have landed just before the close
+        if (ring->closed.load()) return spsc_ring_read_span(ring, span);
+        if (ulTaskNotifyTake(pdTRUE, timeout) == 0) return 0;
+    }
+}
+
+void spsc_ring_release(SpscRing* ring, size_t len) {
+    ring->tail.store(ring->tail.load(std::memory_order_relaxed) + len, std::memory_order_release);
+    Wake(ring->producer);
+}
+
+void spsc_ring_abort(SpscRing* ring) {
+    ring->aborted.store(true);
+    Wake(ring->producer);
+}
+
+bool spsc_ring_closed(const SpscRing* ring) {
+    return ring->closed.load();
+}
+
+bool spsc_ring_aborted(const SpscRing* ring) {
+    return ring->aborted.load();
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+
+#include <freertos/FreeRTOS.h>
+
+// Lock-free byte ring buffer between exactly one producer task and one
+// consumer task. Each side works in place on contiguous spans of the
+// buffer: the producer asks for free space, fills it and commits, the
+// consumer asks for data, processes it and releases. Only the producer
+// moves the write position and only the consumer moves the read position,
+// so no lock is needed.
+//
+// The blocking waits sleep on the calling task's notification and are
+// woken by the other side. Both tasks must still exist when the other side
+// makes its last call on the ring.
+struct SpscRing;
+
+// Capacity is rounded up to a power of two
+SpscRing* spsc_ring_create(size_t capacity);
+void spsc_ring_free(SpscRing* ring);
+
+size_t spsc_ring_capacity(const SpscRing* ring);
+
+// Producer side. The write span is the free space up to the end of the
+// buffer, so it may be shorter than the total free space.
+size_t spsc_ring_write_span(SpscRing* ring, char** span);
+// Waits until there is free space, the consumer aborted or the timeout
+// expired; returns 0 in the last two cases
+size_t spsc_ring_wait_write(SpscRing* ring, char** span, TickType_t timeout);
+void spsc_ring_commit(SpscRing* ring, size_t len);
+// No more data will be written; the consumer drains what is left
+void spsc_ring_close(SpscRing* ring);
+
+// Consumer side, mirroring the producer
+size_t spsc_ring_read_span(SpscRing* ring, const char** span);
+// Waits until there is data, the ring is closed and empty, or the timeout
+// expired; returns 0 in the last two cases
+size_t spsc_ring_wait_read(SpscRing* ring, const char** span, TickType_t timeout);
+void spsc_ring_release(SpscRing* ring, size_t len);
+// The consumer wants no more data, waiting producers return
+void spsc_ring_abort(SpscRing* ring);
+
+bool spsc_ring_closed(const SpscRing* ring);
+bool spsc_ring_aborted(const SpscRing* ring);
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// ASCII case folding and compares. The app is loaded as an ELF and the
+// firmware doesn't export strncmp, strcasecmp or strncasecmp to it, so
+// components use these instead.
+
+inline char ascii_lower(char c) {
+    return c >= 'A' && c <= 'Z' ? (char)(c | 0x20) : c;
+}
+
+// Like strncasecmp
+inline int ascii_ncasecmp(const char* a, const char* b, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        auto ca = (unsigned char)ascii_lower(a[i]);
+        auto cb = (unsigned char)ascii_lower(b[i]);
+        if (ca != cb) return ca - cb;
+        if (ca == '\0') return 0;
+    }
+    return 0;
+}
+
+inline int ascii_casecmp(const char* a, const char* b) {
+    return ascii_ncasecmp(a, b, SIZE_MAX);
+}
+
+inline bool ascii_starts_with(const char* s, const char* prefix) {
+    for (; *prefix != '\0'; s++, prefix++) {
+        if (*s != *prefix) return false;
+    }
+    return true;
+}
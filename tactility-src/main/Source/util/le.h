@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Little-endian fields, varints and the CRC-32 of the on-flash formats:
+// page cache records, the text index, the URL history and page bundles.
+
+inline void put_le16(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+inline void put_le32(uint8_t* p, uint32_t v) {
+    put_le16(p, v);
+    put_le16(p + 2, v >> 16);
+}
+
+inline uint32_t get_le16(const uint8_t* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8;
+}
+
+inline uint32_t get_le32(const uint8_t* p) {
+    return get_le16(p) | get_le16(p + 2) << 16;
+}
+
+// Writes at most 5 bytes and returns how many
+inline size_t put_varint(uint8_t* p, uint32_t v) {
+    size_t len = 0;
+    while (v >= 0x80) {
+        p[len++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    p[len++] = (uint8_t)v;
+    return len;
+}
+
+// Returns the bytes read, 0 if the varint runs past end
+inline size_t get_varint(const uint8_t* p, const uint8_t* end, uint32_t* v) {
+    *v = 0;
+    for (size_t i = 0; i < 5 && p + i < end; i++) {
+        *v |= (uint32_t)(p[i] & 0x7F) << (7 * i);
+        if (!(p[i] & 0x80)) return i + 1;
+    }
+    return 0;
+}
+
+// CRC-32 (IEEE) a nibble at a time, so the table is 64 bytes; pass 0 to
+// start, or the previous result to continue
+inline uint32_t crc32_update(uint32_t crc, const uint8_t* data, size_t len) {
+    static const uint32_t kNibbles[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+    };
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc = kNibbles[(crc ^ data[i]) & 0x0F] ^ (crc >> 4);
+        crc = kNibbles[(crc ^ (data[i] >> 4)) & 0x0F] ^ (crc >> 4);
+    }
+    return ~crc;
+}
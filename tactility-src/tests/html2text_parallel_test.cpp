@@ -0,0 +1,226 @@
+// Checks html2text_convert_parallel() against a serial conversion byte for
+// byte, with the second half on a host thread, and reports how long each
+// takes. The corpus is generated: random pages of every construct the
+// converter handles, and pages built so the split falls inside a comment,
+// script, <pre>, table, link or heading, where the speculation must fail.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "html2text.h"
+
+static int failures = 0;
+
+struct Page {
+    std::string name;
+    std::string html;
+};
+
+// Runs the job on a thread of its own, as the app would on the other core
+struct ThreadWorker {
+    std::thread thread;
+};
+
+static void StartJob(void* ctx, void (*job)(void* arg), void* arg) {
+    static_cast<ThreadWorker*>(ctx)->thread = std::thread(job, arg);
+}
+
+static void WaitJob(void* ctx) {
+    static_cast<ThreadWorker*>(ctx)->thread.join();
+}
+
+static std::string Words(std::minstd_rand& random, size_t count) {
+    static const char* const words[] = {"the",   "quick", "brown",  "fox", "jumps", "over",  "lazy",
+                                        "dog",   "flash", "cache",  "ESP", "page",  "&amp;", "&lt;tag&gt;",
+                                        "caf&eacute;", "&#8212;", "&nbsp;", "a\n\n  b", "x\ty"};
+    std::string out;
+    for (size_t i = 0; i < count; i++) {
+        if (i > 0) out += random() % 9 == 0 ? "\n  " : " ";
+        out += words[random() % (sizeof(words) / sizeof(words[0]))];
+    }
+    return out;
+}
+
+static std::string Inline(std::minstd_rand& random, size_t count) {
+    std::string out;
+    for (size_t i = 0; i < count; i++) {
+        switch (random() % 8) {
+            case 0: out += "<b>" + Words(random, 3) + "</b> "; break;
+            case 1: out += "<em class=\"x\">" + Words(random, 2) + "</em> "; break;
+            case 2: out += "<a href=\"https://example.com/" + std::to_string(random() % 50) + "\">" +
+                           Words(random, 2) + "</a> "; break;
+            case 3: out += "<a href='/rel?a=1&amp;b=\"2\"' title=\"a > b\">" + Words(random, 1) + "</a> "; break;
+            case 4: out += "<br>"; break;
+            case 5: out += "<img src=\"x.png\" alt=\"" + Words(random, 2) + "\"> "; break;
+            default: out += Words(random, 6) + " "; break;
+        }
+    }
+    return out;
+}
+
+static std::string Block(std::minstd_rand& random) {
+    switch (random() % 12) {
+        case 0: return "<h" + std::to_string(random() % 6 + 1) + ">" + Words(random, 4) + "</h1>\n";
+        case 1: {
+            std::string list = random() % 2 ? "<ul>" : "<ol>";
+            for (size_t i = random() % 6 + 1; i > 0; i--) list += "<li>" + Inline(random, 2) + "</li>\n";
+            return list + "</ul>\n";
+        }
+        case 2: {
+            std::string table = "<table>";
+            size_t cols = random() % 4 + 1;
+            for (size_t r = random() % 5 + 1; r > 0; r--) {
+                table += "<tr>";
+                for (size_t c = 0; c < cols; c++) table += (r == 1 ? "<th>" : "<td>") + Words(random, 2) + "</td>";
+                table += "</tr>\n";
+            }
+            return table + "</table>\n";
+        }
+        case 3: return "<pre>  " + Words(random, 8) + "\n    indented  </pre>\n";
+        case 4: return "<script>var s = '<p>not text</p>'; if (a < b) {}</script>\n";
+        case 5: return "<style>p > a { color: red }</style>\n";
+        case 6: return "<!-- <p>hidden " + Words(random, 3) + "</p> -->\n";
+        case 7: return "<div><blockquote>" + Inline(random, 3) + "</blockquote></div>\n";
+        case 8: return "<p>" + Inline(random, 2) + "<p>unclosed " + Words(random, 3) + "\n";
+        default: return "<p>" + Inline(random, 8) + "</p>\n";
+    }
+}
+
+static std::string Head(const std::string& title) {
+    return "<!DOCTYPE html><html><head><meta charset=\"utf-8\"><title>" + title + "</title></head><body>\n";
+}
+
+static std::string RandomPage(unsigned seed, size_t size) {
+    std::minstd_rand random(seed);
+    std::string html = Head("Page " + std::to_string(seed));
+    while (html.size() < size) html += Block(random);
+    return html + "</body></html>\n";
+}
+
+// Blocks up to the middle, then open + filler + close around it, so the
+// split lands inside the construct
+static std::string Straddling(unsigned seed, size_t size, const char* open, const std::string& filler,
+                              const char* close) {
+    std::minstd_rand random(seed);
+    std::string html = Head("Straddling");
+    while (html.size() < size * 2 / 5) html += Block(random);
+    html += open;
+    while (html.size() < size * 3 / 5) html += filler;
+    html += close;
+    while (html.size() < size) html += Block(random);
+    return html + "</body></html>\n";
+}
+
+static std::vector<Page> Corpus() {
+    std::vector<Page> pages;
+    for (unsigned seed = 1; seed <= 24; seed++) {
+        size_t size = 20000 + seed * 9000;
+        pages.push_back({"random " + std::to_string(seed), RandomPage(seed, size)});
+    }
+    // Past the link table
+    std::string links = Head("Links");
+    for (size_t i = 0; links.size() < 120000; i++) {
+        links += "<p><a href=\"https://example.com/l" + std::to_string(i) + "\">link " + std::to_string(i) + "</a></p>\n";
+    }
+    pages.push_back({"many links", links + "</body></html>"});
+
+    const size_t size = 80000;
+    pages.push_back({"in comment", Straddling(101, size, "<!-- ", "<p>commented out</p>\n", " -->")});
+    pages.push_back({"in script", Straddling(102, size, "<script>", "document.write('<p>x</p>');\n", "</script>")});
+    pages.push_back({"in style", Straddling(103, size, "<style>", "div > p { margin: 0 }\n", "</style>")});
+    pages.push_back({"in pre", Straddling(104, size, "<pre>", "<b>code</b>   spaced\n  <i>x</i>\n", "</pre>")});
+    pages.push_back({"in table", Straddling(105, size, "<table>", "<tr><td><p>cell</p></td><td>two</td></tr>\n",
+                                            "</table>")});
+    pages.push_back({"in link", Straddling(106, size, "<a href=\"https://example.com/long\">",
+                                           "<span>link text</span> ", "</a>")});
+    pages.push_back({"in heading", Straddling(107, size, "<h2>", "<span>heading</span> ", "</h2>")});
+    pages.push_back({"in bold", Straddling(108, size, "<b>", "<p>bold paragraph</p>\n", "</b>")});
+    pages.push_back({"in list", Straddling(109, size, "<ol>", "<li><p>item</p></li>\n", "</ol>")});
+    pages.push_back({"in title", "<html><head><title>" + std::string(40000, 't') + "<p>x</p>" +
+                                     std::string(40000, 'u') + "</title></head><body><p>body</p></body></html>"});
+    // A tag name cut at the split, and the same page with text only
+    pages.push_back({"plain text", "<html><body>" + std::string(100000, 'w') + "</body></html>"});
+    return pages;
+}
+
+static double Seconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    // Repeats per page for the timings; 1 is enough for the check
+    int runs = argc > 1 ? atoi(argv[1]) : 1;
+    if (runs < 1) runs = 1;
+
+    ThreadWorker thread_worker;
+    const Html2TextWorker worker = {StartJob, WaitJob, &thread_worker};
+    double serial_time = 0;
+    double parallel_time = 0;
+    size_t html_bytes = 0;
+
+    for (const Page& page : Corpus()) {
+        char* expected = html2text_c(page.html.c_str());
+        if (!expected) {
+            fprintf(stderr, "%s: out of memory\n", page.name.c_str());
+            return 1;
+        }
+        size_t expected_len = strlen(expected);
+        std::vector<char> out(expected_len + 1);
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < runs; i++) {
+            html2text_convert_into(page.html.data(), page.html.size(), out.data(), out.size(), nullptr);
+        }
+        double serial = Seconds(start);
+
+        bool truncated = true;
+        size_t len = 0;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < runs; i++) {
+            len = html2text_convert_parallel(page.html.data(), page.html.size(), out.data(), out.size(), &truncated,
+                                             &worker);
+        }
+        double parallel = Seconds(start);
+
+        if (len != expected_len || truncated || memcmp(out.data(), expected, expected_len + 1) != 0) {
+            size_t at = 0;
+            while (at < expected_len && at < len && out[at] == expected[at]) at++;
+            fprintf(stderr, "%s: parallel text differs at byte %zu (%zu vs %zu bytes)\n", page.name.c_str(), at,
+                    len, expected_len);
+            failures++;
+        }
+
+        // Cut short it may differ, but must stay in bounds and say so
+        if (expected_len > 16) {
+            std::vector<char> small(expected_len / 2);
+            len = html2text_convert_parallel(page.html.data(), page.html.size(), small.data(), small.size(),
+                                             &truncated, &worker);
+            if (len >= small.size() || small[len] != '\0' || !truncated) {
+                fprintf(stderr, "%s: truncated conversion overran or wasn't flagged\n", page.name.c_str());
+                failures++;
+            }
+        }
+
+        printf("%-12s %7zu -> %6zu bytes  serial %8.3f ms  parallel %8.3f ms\n", page.name.c_str(),
+               page.html.size(), expected_len, serial * 1000 / runs, parallel * 1000 / runs);
+        serial_time += serial;
+        parallel_time += parallel;
+        html_bytes += page.html.size() * (size_t)runs;
+        free(expected);
+    }
+
+    printf("total: serial %.1f MB/s, parallel %.1f MB/s, speedup %.2fx\n", (double)html_bytes / serial_time / 1e6,
+           (double)html_bytes / parallel_time / 1e6, serial_time / parallel_time);
+    if (failures > 0) {
+        fprintf(stderr, "html2text_parallel_test: %d pages differ\n", failures);
+        return 1;
+    }
+    printf("html2text_parallel_test: all passed\n");
+    return 0;
+}
@@ -0,0 +1,87 @@
+// Host tests for the converter: small pages for markup that once lost or
+// garbled text, each with the exact text it must convert to.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "html2text.h"
+
+static int failures = 0;
+
+static void Check(const char* html, const char* expected) {
+    char* text = html2text_c(html);
+    if (!text || strcmp(text, expected) != 0) {
+        fprintf(stderr, "%s\n  gave:     \"%s\"\n  expected: \"%s\"\n", html, text ? text : "(null)", expected);
+        failures++;
+    }
+    free(text);
+}
+
+// Converts with a stream to get the title as well
+static void CheckTitle(const char* html, const char* expected_title, const char* expected) {
+    Html2TextStream* stream = html2text_stream_create(64 * 1024);
+    if (!stream || !html2text_stream_feed(stream, html, strlen(html))) {
+        fprintf(stderr, "%s\n  out of memory\n", html);
+        failures++;
+        html2text_stream_free(stream);
+        return;
+    }
+    const char* title = html2text_stream_title(stream);
+    if (!title) title = "(null)";
+    bool title_ok = strcmp(title, expected_title) == 0;
+    if (!title_ok) fprintf(stderr, "%s\n  title:    \"%s\"\n  expected: \"%s\"\n", html, title, expected_title);
+    char* text = html2text_stream_finish(stream, nullptr);
+    if (!text || strcmp(text, expected) != 0) {
+        fprintf(stderr, "%s\n  gave:     \"%s\"\n  expected: \"%s\"\n", html, text ? text : "(null)", expected);
+    }
+    if (!title_ok || !text || strcmp(text, expected) != 0) failures++;
+    free(text);
+}
+
+// A self-closing skipped element has no content, so the page goes on after it
+static void TestSelfClosingSkip() {
+    Check("<p>Before</p><svg/><p>After the icon</p>", "Before\n\nAfter the icon");
+    Check("<p>Before</p><iframe src=x /><p>After</p>", "Before\n\nAfter");
+    Check("<p>Before</p><svg viewBox=\"0 0 1 1\" /><p>After</p>", "Before\n\nAfter");
+    Check("<p>a</p><svg width=\"1\"><p>hidden</p></svg><p>b</p>", "a\n\nb");
+    // A '/' inside a value doesn't close the tag
+    Check("<p>a</p><svg a=\"/\"><p>hidden</p></svg><p>b</p>", "a\n\nb");
+}
+
+// An unclosed title ends at the first tag of the body, or when it's full
+static void TestUnclosedTitle() {
+    CheckTitle("<title>Hi<p>Body text here</p><p>More</p>", "Hi", "Body text here\n\nMore");
+    CheckTitle("<title>Hi</title><meta charset=utf-8><p>Text</p>", "Hi", "Text");
+    CheckTitle("<title>Hi<script>x()</script><body>Text", "Hi", "Text");
+    std::string words;
+    for (int i = 0; i < 40; i++) words += "word ";
+    std::string expected_text;
+    for (int i = 19; i < 40; i++) expected_text += i > 19 ? " word" : "word";
+    CheckTitle(("<title>" + words).c_str(), words.substr(0, 19 * 5 - 1).c_str(), expected_text.c_str());
+}
+
+// Character references in attribute values are decoded, links to the
+// real characters and alt text like page text
+static void TestAttributeEntities() {
+    Check("<a href=\"/s?a=1&amp;b=2\">x</a>", "x[1]\n\nReferences\n1. /s?a=1&b=2");
+    Check("<base href=\"http://h.com/a&amp;b/\"><a href=\"c?x=&#38;&#x41;&quot;\">l</a>",
+          "l[1]\n\nReferences\n1. http://h.com/a&b/c?x=&A\"");
+    Check("<a href=\"/q?t=&#233;&amp\">e</a>", "e[1]\n\nReferences\n1. /q?t=\xC3\xA9&amp");
+    Check("<meta http-equiv=\"refresh\" content=\"0; url=/n?a=1&amp;b=2\"><p>Moved</p>",
+          "Moved\n\nReferences\n1. /n?a=1&b=2");
+    Check("<img alt=\"Tom &amp; Jerry &mdash; &bogus; ok\">", "Tom & Jerry -- &bogus; ok");
+}
+
+int main() {
+    TestSelfClosingSkip();
+    TestUnclosedTitle();
+    TestAttributeEntities();
+    if (failures > 0) {
+        fprintf(stderr, "html2text_test: %d cases failed\n", failures);
+        return 1;
+    }
+    printf("html2text_test: all passed\n");
+    return 0;
+}
@@ -0,0 +1,97 @@
+// Host tests for packed pages: a round trip, and heading tables that a
+// damaged bundle or cache record could hold, which page_unpack() must
+// reject rather than hand to the outline.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "page_pack.h"
+
+static int failures = 0;
+
+#define CHECK(cond)                                                                \
+    do {                                                                           \
+        if (!(cond)) {                                                             \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                            \
+        }                                                                          \
+    } while (0)
+
+static const char* const kText = "Title\nSome text under it\nSection\nMore text";
+
+static void TestRoundTrip() {
+    const Html2TextHeading headings[] = {{0, 1}, {24, 2}, {(uint32_t)strlen(kText), 6}};
+    size_t len = 0;
+    uint8_t* packed = page_pack(kText, headings, 3, &len);
+    CHECK(packed != nullptr);
+    if (!packed) return;
+
+    Html2TextHeading* out = nullptr;
+    size_t count = 0;
+    char* text = page_unpack(packed, len, &out, &count);
+    CHECK(text && strcmp(text, kText) == 0);
+    CHECK(count == 3);
+    for (size_t i = 0; text && i < count; i++) {
+        CHECK(out[i].offset == headings[i].offset && out[i].level == headings[i].level);
+    }
+    // Heading 2, little-endian, with zeroed padding
+    const uint8_t expected[8] = {24, 0, 0, 0, 2, 0, 0, 0};
+    CHECK(memcmp(packed + 2 + 8, expected, sizeof(expected)) == 0);
+    free(text);
+    free(out);
+    free(packed);
+}
+
+// Packs a good page, then overwrites the one heading's level and offset
+static void CheckRejected(const char* what, uint8_t level, uint32_t offset) {
+    const Html2TextHeading heading = {0, 1};
+    size_t len = 0;
+    uint8_t* packed = page_pack(kText, &heading, 1, &len);
+    CHECK(packed != nullptr);
+    if (!packed) return;
+    for (size_t i = 0; i < 4; i++) packed[2 + i] = (uint8_t)(offset >> (8 * i));
+    packed[6] = level;
+
+    Html2TextHeading* out = nullptr;
+    size_t count = 0;
+    char* text = page_unpack(packed, len, &out, &count);
+    if (text) fprintf(stderr, "%s: accepted\n", what);
+    CHECK(text == nullptr);
+    free(text);
+    free(out);
+    free(packed);
+}
+
+static void TestBadHeadings() {
+    CheckRejected("level 0", 0, 0);
+    CheckRejected("level 7", 7, 0);
+    CheckRejected("level 255", 255, 0);
+    CheckRejected("offset past the text", 1, (uint32_t)strlen(kText) + 1);
+    CheckRejected("offset 0xFFFFFFFF", 1, 0xFFFFFFFF);
+}
+
+// A heading count larger than the record
+static void TestShortTable() {
+    size_t len = 0;
+    uint8_t* packed = page_pack(kText, nullptr, 0, &len);
+    CHECK(packed != nullptr);
+    if (!packed) return;
+    packed[0] = 0xFF;
+    Html2TextHeading* out = nullptr;
+    size_t count = 0;
+    CHECK(page_unpack(packed, len, &out, &count) == nullptr);
+    free(packed);
+}
+
+int main() {
+    TestRoundTrip();
+    TestBadHeadings();
+    TestShortTable();
+    if (failures > 0) {
+        fprintf(stderr, "page_pack_test: %d checks failed\n", failures);
+        return 1;
+    }
+    printf("page_pack_test: all passed\n");
+    return 0;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+// The few FreeRTOS types and constants the app's components use, for
+// building them on the host. Tasks are std::threads; see task.h.
+
+#include <cstdint>
+
+typedef uint32_t TickType_t;
+typedef int32_t BaseType_t;
+typedef uint32_t UBaseType_t;
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdPASS pdTRUE
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+// One tick per millisecond, as the app's targets are configured
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
@@ -0,0 +1,55 @@
+#pragma once
+
+// Direct-to-task notifications on host threads: each thread gets a task
+// handle on first use, holding a notification count behind a mutex and
+// condition variable, which is all xTaskNotifyGive/ulTaskNotifyTake need.
+// Handles live until the process exits, so a thread that has finished can
+// still be notified like a FreeRTOS task that is still around.
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+#include "FreeRTOS.h"
+
+struct HostTask {
+    std::mutex mutex;
+    std::condition_variable wake;
+    uint32_t notifications = 0;
+};
+
+typedef HostTask* TaskHandle_t;
+
+inline TaskHandle_t xTaskGetCurrentTaskHandle() {
+    static std::mutex tasks_mutex;
+    static std::deque<HostTask> tasks;     // never moves its elements
+    thread_local HostTask* task = [] {
+        std::lock_guard<std::mutex> lock(tasks_mutex);
+        return &tasks.emplace_back();
+    }();
+    return task;
+}
+
+inline BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    {
+        std::lock_guard<std::mutex> lock(task->mutex);
+        task->notifications++;
+    }
+    task->wake.notify_one();
+    return pdPASS;
+}
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks) {
+    HostTask* task = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> lock(task->mutex);
+    auto notified = [task] { return task->notifications > 0; };
+    if (ticks == portMAX_DELAY) {
+        task->wake.wait(lock, notified);
+    } else if (!task->wake.wait_for(lock, std::chrono::milliseconds(ticks), notified)) {
+        return 0;
+    }
+    uint32_t count = task->notifications;
+    task->notifications = clear_on_exit ? 0 : count - 1;
+    return count;
+}
@@ -0,0 +1,246 @@
+// Host tests for the SPSC ring: spans across the wrap point, close and
+// abort from either side, timeouts, and a producer and consumer thread
+// moving a checked byte stream through small rings at full speed.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+
+#include "spsc_ring.h"
+
+static int failures = 0;
+
+#define CHECK(cond)                                                                \
+    do {                                                                           \
+        if (!(cond)) {                                                             \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                            \
+        }                                                                          \
+    } while (0)
+
+// Byte n of the test stream, not periodic in any power of two
+static char StreamByte(size_t n) {
+    return (char)(n % 251);
+}
+
+static void TestCapacity() {
+    SpscRing* ring = spsc_ring_create(100);
+    CHECK(ring && spsc_ring_capacity(ring) == 128);
+    spsc_ring_free(ring);
+    ring = spsc_ring_create(1);
+    CHECK(ring && spsc_ring_capacity(ring) == 1);
+    spsc_ring_free(ring);
+}
+
+// Odd-sized writes and reads on one thread, so every span lands across the
+// end of the buffer sooner or later
+static void TestWraparound() {
+    SpscRing* ring = spsc_ring_create(16);
+    size_t written = 0;
+    size_t read = 0;
+    bool short_span = false;
+    for (size_t round = 0; round < 1000; round++) {
+        size_t want = round % 7 + 1;
+        while (want > 0) {
+            char* span;
+            size_t len = spsc_ring_write_span(ring, &span);
+            if (len == 0) break;
+            size_t n = len < want ? len : want;
+            for (size_t i = 0; i < n; i++) span[i] = StreamByte(written + i);
+            spsc_ring_commit(ring, n);
+            written += n;
+            want -= n;
+        }
+        CHECK(written - read <= spsc_ring_capacity(ring));
+
+        size_t take = round % 5 + 1;
+        while (take > 0) {
+            const char* span;
+            size_t len = spsc_ring_read_span(ring, &span);
+            if (len == 0) break;
+            // A span stops at the end of the buffer even with more data
+            // past it
+            if (len < written - read) short_span = true;
+            size_t n = len < take ? len : take;
+            for (size_t i = 0; i < n; i++) CHECK(span[i] == StreamByte(read + i));
+            spsc_ring_release(ring, n);
+            read += n;
+            take -= n;
+        }
+    }
+    CHECK(written > 16 * 100);
+    CHECK(short_span);
+
+    // A full ring has no write span, an empty one no read span
+    char* wspan;
+    const char* rspan;
+    while (spsc_ring_write_span(ring, &wspan) > 0) {
+        spsc_ring_commit(ring, spsc_ring_write_span(ring, &wspan));
+    }
+    CHECK(spsc_ring_write_span(ring, &wspan) == 0);
+    while (size_t len = spsc_ring_read_span(ring, &rspan)) spsc_ring_release(ring, len);
+    CHECK(spsc_ring_read_span(ring, &rspan) == 0);
+    spsc_ring_free(ring);
+}
+
+static void TestTimeouts() {
+    SpscRing* ring = spsc_ring_create(4);
+    const char* rspan;
+    CHECK(spsc_ring_wait_read(ring, &rspan, 5) == 0);
+
+    char* wspan;
+    spsc_ring_commit(ring, spsc_ring_write_span(ring, &wspan));
+    CHECK(spsc_ring_wait_write(ring, &wspan, 5) == 0);
+    spsc_ring_free(ring);
+}
+
+// What was committed before the close is still read, then reads return 0;
+// a consumer asleep on an empty ring is woken by the close
+static void TestClose() {
+    SpscRing* ring = spsc_ring_create(8);
+    char* wspan;
+    CHECK(spsc_ring_write_span(ring, &wspan) == 8);
+    memcpy(wspan, "abc", 3);
+    spsc_ring_commit(ring, 3);
+    spsc_ring_close(ring);
+    CHECK(spsc_ring_closed(ring));
+
+    const char* rspan;
+    size_t len = spsc_ring_wait_read(ring, &rspan, portMAX_DELAY);
+    CHECK(len == 3 && memcmp(rspan, "abc", 3) == 0);
+    spsc_ring_release(ring, len);
+    CHECK(spsc_ring_wait_read(ring, &rspan, portMAX_DELAY) == 0);
+    spsc_ring_free(ring);
+
+    ring = spsc_ring_create(8);
+    std::atomic<size_t> result{1};
+    std::thread consumer([&] {
+        const char* span;
+        result = spsc_ring_wait_read(ring, &span, portMAX_DELAY);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    spsc_ring_close(ring);
+    consumer.join();
+    CHECK(result == 0);
+    spsc_ring_free(ring);
+}
+
+// A producer asleep on a full ring returns 0 once the consumer aborts, and
+// waits after that return at once
+static void TestAbort() {
+    SpscRing* ring = spsc_ring_create(4);
+    char* wspan;
+    spsc_ring_commit(ring, spsc_ring_write_span(ring, &wspan));
+
+    std::atomic<size_t> result{1};
+    std::thread producer([&] {
+        char* span;
+        result = spsc_ring_wait_write(ring, &span, portMAX_DELAY);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    spsc_ring_abort(ring);
+    producer.join();
+    CHECK(result == 0);
+    CHECK(spsc_ring_aborted(ring));
+
+    const char* rspan;
+    spsc_ring_release(ring, spsc_ring_read_span(ring, &rspan));
+    CHECK(spsc_ring_wait_write(ring, &wspan, portMAX_DELAY) == 0);
+    spsc_ring_free(ring);
+}
+
+// Both sides flat out with random chunk sizes, blocking on each other all
+// the time; every byte must arrive once and in order
+static void TestStress(size_t capacity, size_t total) {
+    SpscRing* ring = spsc_ring_create(capacity);
+    std::thread producer([&] {
+        std::minstd_rand random(1);
+        size_t written = 0;
+        while (written < total) {
+            char* span;
+            size_t len = spsc_ring_wait_write(ring, &span, portMAX_DELAY);
+            if (len == 0) break;
+            size_t n = random() % len + 1;
+            if (n > total - written) n = total - written;
+            for (size_t i = 0; i < n; i++) span[i] = StreamByte(written + i);
+            spsc_ring_commit(ring, n);
+            written += n;
+        }
+        spsc_ring_close(ring);
+    });
+
+    std::minstd_rand random(2);
+    size_t read = 0;
+    size_t bad = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (true) {
+        const char* span;
+        size_t len = spsc_ring_wait_read(ring, &span, portMAX_DELAY);
+        if (len == 0) break;
+        size_t n = random() % len + 1;
+        for (size_t i = 0; i < n; i++) {
+            if (span[i] != StreamByte(read + i)) bad++;
+        }
+        spsc_ring_release(ring, n);
+        read += n;
+    }
+    producer.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    CHECK(read == total);
+    CHECK(bad == 0);
+    printf("stress: capacity %zu, %zu bytes in %.3f s\n", capacity, read, seconds);
+    spsc_ring_free(ring);
+}
+
+// The consumer aborts midway, as the converter does when its text budget
+// runs out; the producer must stop rather than hang
+static void TestStressAbort() {
+    SpscRing* ring = spsc_ring_create(64);
+    std::atomic<size_t> written{0};
+    std::thread producer([&] {
+        while (true) {
+            char* span;
+            size_t len = spsc_ring_wait_write(ring, &span, portMAX_DELAY);
+            if (len == 0) break;
+            spsc_ring_commit(ring, len);
+            written += len;
+        }
+        spsc_ring_close(ring);
+    });
+
+    size_t read = 0;
+    while (true) {
+        const char* span;
+        size_t len = spsc_ring_wait_read(ring, &span, portMAX_DELAY);
+        if (len == 0) break;
+        spsc_ring_release(ring, len);
+        read += len;
+        if (read > 1024 * 1024) spsc_ring_abort(ring);
+    }
+    producer.join();
+    CHECK(spsc_ring_aborted(ring) && spsc_ring_closed(ring));
+    CHECK(read == written);
+    spsc_ring_free(ring);
+}
+
+int main() {
+    TestCapacity();
+    TestWraparound();
+    TestTimeouts();
+    TestClose();
+    TestAbort();
+    TestStress(1, 1024 * 1024);
+    TestStress(16, 16 * 1024 * 1024);
+    TestStress(8192, 64 * 1024 * 1024);
+    TestStressAbort();
+    if (failures > 0) {
+        fprintf(stderr, "spsc_ring_test: %d checks failed\n", failures);
+        return 1;
+    }
+    printf("spsc_ring_test: all passed\n");
+    return 0;
+}
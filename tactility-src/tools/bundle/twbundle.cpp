@@ -0,0 +1,310 @@
+// Builds an offline page bundle from a directory of HTML files, converting
+// them with the app's own html2text and packing them the way it does. See
+// page_bundle_format.h for the layout.
+//
+//   twbundle [-n name] [-m max_text] out.twb html_dir
+//
+// Copy the bundle to /sdcard/tactileweb, or flash it to a "webbundle" data
+// partition for an app built with TACTILEWEB_BUNDLE_PARTITION:
+//
+//   parttool.py write_partition --partition-name=webbundle --input=out.twb
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "compress/page_pack.h"
+#include "html2text/html2text.h"
+#include "page_bundle_format.h"
+
+namespace fs = std::filesystem;
+
+// The app's limits, so a bundled page shows up just like a loaded one
+constexpr size_t kMaxHeadings = 64;
+constexpr size_t kMaxSpans = 1024;
+constexpr size_t kMaxLabelLen = 63;
+
+struct Link {
+    std::string url;
+    std::string label;
+    uint16_t target;
+};
+
+struct Page {
+    std::string path;
+    std::string title;
+    std::vector<uint8_t> packed;
+    std::vector<Link> links;
+};
+
+// NUL-terminated strings, each stored once
+struct StringPool {
+    std::vector<char> bytes;
+    std::map<std::string, uint32_t> offsets;
+
+    uint32_t Add(const std::string& s) {
+        auto found = offsets.find(s);
+        if (found != offsets.end()) return found->second;
+        auto offset = (uint32_t)bytes.size();
+        bytes.insert(bytes.end(), s.begin(), s.end());
+        bytes.push_back('\0');
+        offsets[s] = offset;
+        return offset;
+    }
+};
+
+static void PutLe16(std::vector<uint8_t>& out, uint32_t v) {
+    out.push_back((uint8_t)v);
+    out.push_back((uint8_t)(v >> 8));
+}
+
+static void PutLe32(std::vector<uint8_t>& out, uint32_t v) {
+    PutLe16(out, v);
+    PutLe16(out, v >> 16);
+}
+
+static bool ReadFile(const fs::path& path, std::string* data) {
+    FILE* file = fopen(path.string().c_str(), "rb");
+    if (!file) return false;
+    char buffer[4096];
+    size_t len;
+    while ((len = fread(buffer, 1, sizeof(buffer), file)) > 0) data->append(buffer, len);
+    bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
+
+static bool HasScheme(const std::string& url) {
+    for (char c : url) {
+        if (c == ':') return true;
+        if (c == '/' || c == '?' || c == '#') return false;
+    }
+    return false;
+}
+
+// Resolves a relative href against the directory of the page it's on, to
+// a bundle path
+static std::string ResolvePath(const std::string& page, std::string href) {
+    href = href.substr(0, href.find_first_of("?#"));
+    if (href.empty()) return page;
+    std::string joined = href[0] == '/' ? href.substr(1) : page.substr(0, page.rfind('/') + 1) + href;
+    if (joined.empty() || joined.back() == '/') joined += "index.html";
+
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (start <= joined.size()) {
+        size_t end = joined.find('/', start);
+        if (end == std::string::npos) end = joined.size();
+        std::string part = joined.substr(start, end - start);
+        if (part == "..") {
+            if (!parts.empty()) parts.pop_back();
+        } else if (!part.empty() && part != ".") {
+            parts.push_back(part);
+        }
+        start = end + 1;
+    }
+    std::string path;
+    for (const std::string& part : parts) {
+        path += path.empty() ? part : "/" + part;
+    }
+    return path;
+}
+
+// The text of a link's spans with whitespace collapsed and its "[n]"
+// marker dropped, cut to fit without splitting a UTF-8 character
+static std::string LinkLabel(const Html2TextDocument& doc, size_t link) {
+    std::string label;
+    size_t end = 0;
+    for (size_t i = 0; i < doc.span_count; i++) {
+        const Html2TextSpan& span = doc.spans[i];
+        if (!(span.style & HTML2TEXT_LINK) || span.link != link) continue;
+        if (!label.empty() && span.offset > end) label += ' ';
+        for (size_t j = span.offset; j < span.offset + span.length && j < doc.text_len; j++) {
+            char c = doc.text[j] == '\n' ? ' ' : doc.text[j];
+            if (c != ' ' || (!label.empty() && label.back() != ' ')) label += c;
+        }
+        end = span.offset + span.length;
+    }
+    size_t marker = label.rfind('[');
+    if (marker != std::string::npos && label.back() == ']' &&
+        label.find_first_not_of("0123456789", marker + 1) == label.size() - 1) {
+        label.resize(marker);
+    }
+    while (!label.empty() && label.back() == ' ') label.pop_back();
+    if (label.size() > kMaxLabelLen) {
+        size_t len = kMaxLabelLen;
+        while (len > 0 && ((uint8_t)label[len] & 0xC0) == 0x80) len--;
+        label.resize(len);
+    }
+    return label;
+}
+
+static bool ConvertPage(const fs::path& file, Page* page, size_t max_text, std::vector<std::string>* hrefs) {
+    std::string html;
+    if (!ReadFile(file, &html)) {
+        fprintf(stderr, "twbundle: can't read %s\n", file.string().c_str());
+        return false;
+    }
+
+    Html2TextStream* stream = html2text_stream_create(max_text);
+    if (!stream || !html2text_stream_track_spans(stream, kMaxSpans) ||
+        !html2text_stream_track_headings(stream, kMaxHeadings)) {
+        html2text_stream_free(stream);
+        return false;
+    }
+    html2text_stream_feed(stream, html.data(), html.size());
+    const char* title = html2text_stream_title(stream);
+    page->title = title ? title : "";
+    size_t heading_count = 0;
+    Html2TextHeading* headings = html2text_stream_take_headings(stream, &heading_count);
+
+    Html2TextDocument doc;
+    if (!html2text_stream_finish_document(stream, &doc)) {
+        free(headings);
+        return false;
+    }
+    if (doc.truncated) {
+        fprintf(stderr, "twbundle: %s cut to %zu bytes of text\n", page->path.c_str(), max_text);
+    }
+
+    size_t packed_len = 0;
+    uint8_t* packed = page_pack(doc.text, headings, heading_count, &packed_len);
+    free(headings);
+    if (packed) {
+        page->packed.assign(packed, packed + packed_len);
+        free(packed);
+    }
+    for (size_t i = 0; i < doc.link_count; i++) {
+        hrefs->push_back(doc.links + doc.link_offsets[i]);
+        page->links.push_back({"", LinkLabel(doc, i), kPageBundleExternal});
+    }
+    html2text_document_free(&doc);
+    return packed != nullptr;
+}
+
+int main(int argc, char** argv) {
+    std::string name;
+    size_t max_text = 32 * 1024;
+    int arg = 1;
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+        if (strcmp(argv[arg], "-n") == 0) {
+            name = argv[arg + 1];
+        } else if (strcmp(argv[arg], "-m") == 0) {
+            max_text = strtoul(argv[arg + 1], nullptr, 10);
+        } else {
+            break;
+        }
+    }
+    if (argc - arg != 2 || max_text == 0) {
+        fprintf(stderr, "usage: twbundle [-n name] [-m max_text] out.twb html_dir\n");
+        return 2;
+    }
+    fs::path out_path = argv[arg];
+    fs::path root = argv[arg + 1];
+    if (name.empty()) {
+        fs::path dir = fs::absolute(root).lexically_normal();
+        name = (dir.has_filename() ? dir : dir.parent_path()).filename().string();
+    }
+
+    std::vector<Page> pages;
+    std::error_code error;
+    for (auto it = fs::recursive_directory_iterator(root, error); !error && it != fs::end(it); it.increment(error)) {
+        std::string ext = it->path().extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return (char)tolower(c); });
+        if (it->is_regular_file() && (ext == ".html" || ext == ".htm")) {
+            pages.push_back({fs::relative(it->path(), root).generic_string(), "", {}, {}});
+        }
+    }
+    if (error || pages.empty()) {
+        fprintf(stderr, "twbundle: no pages found in %s\n", root.string().c_str());
+        return 1;
+    }
+    if (pages.size() >= kPageBundleExternal) {
+        fprintf(stderr, "twbundle: %zu pages in %s, a bundle holds at most %zu\n", pages.size(),
+                root.string().c_str(), (size_t)kPageBundleExternal - 1);
+        return 1;
+    }
+    // The reader binary searches by path
+    std::sort(pages.begin(), pages.end(), [](const Page& a, const Page& b) { return a.path < b.path; });
+    std::map<std::string, uint16_t> index;
+    for (size_t i = 0; i < pages.size(); i++) index[pages[i].path] = (uint16_t)i;
+
+    for (Page& page : pages) {
+        std::vector<std::string> hrefs;
+        if (!ConvertPage(root / page.path, &page, max_text, &hrefs)) {
+            fprintf(stderr, "twbundle: can't convert %s\n", page.path.c_str());
+            return 1;
+        }
+        for (size_t i = 0; i < hrefs.size(); i++) {
+            Link& link = page.links[i];
+            link.url = hrefs[i];
+            if (HasScheme(hrefs[i]) || hrefs[i].compare(0, 2, "//") == 0) continue;
+            auto found = index.find(ResolvePath(page.path, hrefs[i]));
+            if (found != index.end()) {
+                link.url = found->first;
+                link.target = found->second;
+            } else {
+                fprintf(stderr, "twbundle: %s links to %s, which isn't bundled\n", page.path.c_str(),
+                        hrefs[i].c_str());
+            }
+        }
+    }
+
+    // Header, directory, page data, link tables, strings
+    StringPool strings;
+    uint32_t name_offset = strings.Add(name);
+    std::vector<uint8_t> directory;
+    std::vector<uint8_t> data;
+    std::vector<uint8_t> links;
+    size_t data_start = kPageBundleHeaderSize + pages.size() * kPageBundleEntrySize;
+    size_t total_links = 0;
+    for (const Page& page : pages) total_links += page.links.size();
+    size_t links_start = data_start;
+    for (const Page& page : pages) links_start += page.packed.size();
+
+    for (const Page& page : pages) {
+        PutLe32(directory, strings.Add(page.path));
+        PutLe32(directory, strings.Add(page.title));
+        PutLe32(directory, (uint32_t)(data_start + data.size()));
+        PutLe32(directory, (uint32_t)page.packed.size());
+        PutLe32(directory, (uint32_t)(links_start + links.size()));
+        PutLe16(directory, (uint32_t)page.links.size());
+        PutLe16(directory, 0);
+        data.insert(data.end(), page.packed.begin(), page.packed.end());
+        for (const Link& link : page.links) {
+            PutLe32(links, strings.Add(link.url));
+            PutLe32(links, strings.Add(link.label));
+            PutLe16(links, link.target);
+            PutLe16(links, 0);
+        }
+    }
+
+    std::vector<uint8_t> header;
+    PutLe32(header, kPageBundleMagic);
+    PutLe16(header, kPageBundleVersion);
+    PutLe16(header, (uint32_t)pages.size());
+    PutLe32(header, (uint32_t)(links_start + links.size()));
+    PutLe32(header, (uint32_t)strings.bytes.size());
+    PutLe32(header, name_offset);
+    PutLe32(header, 0);
+
+    FILE* out = fopen(out_path.string().c_str(), "wb");
+    bool ok = out && fwrite(header.data(), 1, header.size(), out) == header.size() &&
+              fwrite(directory.data(), 1, directory.size(), out) == directory.size() &&
+              fwrite(data.data(), 1, data.size(), out) == data.size() &&
+              fwrite(links.data(), 1, links.size(), out) == links.size() &&
+              fwrite(strings.bytes.data(), 1, strings.bytes.size(), out) == strings.bytes.size();
+    if (out && fclose(out) != 0) ok = false;
+    if (!ok) {
+        fprintf(stderr, "twbundle: can't write %s\n", out_path.string().c_str());
+        return 1;
+    }
+    printf("%s: %zu pages, %zu links, %zu bytes\n", out_path.string().c_str(), pages.size(), total_links,
+           header.size() + directory.size() + data.size() + links.size() + strings.bytes.size());
+    return 0;
+}